@@ -0,0 +1,584 @@
+// Benchmark suite (Benchmarks.vcxproj, native console program): training,
+// inference, data preparation and weight file I/O over the shapes the UI
+// offers (2-7 hidden layers, 2-7 classes), plus a thread count sweep of the
+// parallel training modes. Results go out as one JSON document. With
+// --baseline every result is compared against a document written by an
+// earlier run and the program exits with 1 if any of them got slower by
+// more than the tolerance.
+//
+//   Benchmarks [--quick] [--out results.json] [--baseline baseline.json]
+//              [--tolerance 0.15] [--kernels scalar|sse2|avx2|avx512]
+
+#include "pch.h"
+#include "NeuralNetwork.h"
+#include "Optimizer.h"
+#include "Process.h"
+#include "Dataset.h"
+#include "Normalization.h"
+#include "QuantizedModel.h"
+#include "EnsembleModel.h"
+#include "HalfPrecisionModel.h"
+#include "StaticNetwork.h"
+#include "ThreadPool.h"
+#include "Kernels.h"
+#include "TrainingConfig.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define BENCH_MIN_SECONDS 0.25
+#define BENCH_QUICK_SECONDS 0.05
+#define BENCH_TOLERANCE 0.15
+#define BENCH_GRID_POINTS 65536
+#define BENCH_SAMPLES_FILE "benchmark_samples.tmp"
+#define BENCH_WEIGHTS_FILE "benchmark_weights.tmp"
+
+struct BenchResult
+{
+    std::string id;
+    std::string metric;
+    double value;
+    bool higherIsBetter;
+};
+
+static std::vector<BenchResult> s_results;
+static double s_minSeconds = BENCH_MIN_SECONDS;
+
+static void report(const std::string& id, const char* metric, double value, bool higherIsBetter)
+{
+    BenchResult result;
+    result.id = id;
+    result.metric = metric;
+    result.value = value;
+    result.higherIsBetter = higherIsBetter;
+    s_results.push_back(result);
+    fprintf(stderr, "  %-44s %14.2f %s\n", id.c_str(), value, metric);
+}
+
+// Runs run(reps) with doubling repetition counts until one call takes at
+// least s_minSeconds; returns seconds per repetition
+template <typename Run>
+static double timeRepeated(Run run)
+{
+    for (int reps = 1;; reps *= 2)
+    {
+        double start = MonotonicSeconds();
+        run(reps);
+        double elapsed = MonotonicSeconds() - start;
+        if (elapsed >= s_minSeconds || reps >= (1 << 24))
+            return elapsed / reps;
+    }
+}
+
+static std::string shapeId(const char* name, int hidden, int classes, int neurons)
+{
+    char id[96];
+    snprintf(id, sizeof(id), "%s/h%d/c%d/n%d", name, hidden, classes, neurons);
+    return id;
+}
+
+// 2-D points like the ones drawn in the UI, labelled by angle sector
+static void makeSamples(int count, int classes, std::vector<float>* data, std::vector<int>* labels)
+{
+    data->resize((size_t)count * 2);
+    labels->resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        float x = (float)(rand() % 800 - 400);
+        float y = (float)(rand() % 600 - 300);
+        (*data)[2 * i] = x;
+        (*data)[2 * i + 1] = y;
+        float angle = atan2f(y, x) + 3.14159265f;
+        int label = (int)(angle / (6.2831853f / classes));
+        (*labels)[i] = (label < classes) ? label : classes - 1;
+    }
+}
+
+static void initModel(NeuralModel& model, int hidden, int neurons, int classes)
+{
+    std::vector<int> units(hidden, neurons);
+    srand(1);
+    model.InitializeModel(hidden, units.data(), 2, classes);
+}
+
+// Exactly epochs passes: the target error can never be reached
+static TrainingConfig fixedEpochs(int epochs, int batchSize)
+{
+    TrainingConfig config;
+    config.maxEpochs = epochs;
+    config.targetError = -1;
+    config.batchSize = batchSize;
+    return config;
+}
+
+static void benchTraining(bool quick)
+{
+    fprintf(stderr, "training (performSGDTraining / performSGDTrainingWithMomentum loops)\n");
+    std::vector<int> hiddenSweep = quick ? std::vector<int>{ 2, 7 } : std::vector<int>{ 2, 3, 4, 5, 6, 7 };
+    std::vector<int> classSweep = quick ? std::vector<int>{ 2, 7 } : std::vector<int>{ 2, 4, 7 };
+    std::vector<int> neuronSweep = quick ? std::vector<int>{ 8 } : std::vector<int>{ 4, 16, 64 };
+    std::vector<int> sampleSweep = quick ? std::vector<int>{ 256 } : std::vector<int>{ 256, 4096 };
+
+    for (int samples : sampleSweep)
+        for (int hidden : hiddenSweep)
+            for (int classes : classSweep)
+                for (int neurons : neuronSweep)
+                {
+                    std::vector<float> raw;
+                    std::vector<int> labels;
+                    makeSamples(samples, classes, &raw, &labels);
+                    float mean[2], variance[2];
+                    float* data = Batch_Norm(raw.data(), samples, 2, mean, variance);
+
+                    for (int momentum = 0; momentum < 2; momentum++)
+                    {
+                        NeuralModel model;
+                        initModel(model, hidden, neurons, classes);
+                        SGDOptimizer sgd((float)LEARNING_RATE);
+                        MomentumOptimizer moment((float)LEARNING_RATE, (float)MOMENT_RATE);
+                        Optimizer& optimizer = momentum ? (Optimizer&)moment : (Optimizer&)sgd;
+
+                        double seconds = timeRepeated([&](int epochs) {
+                            model.Train(data, labels.data(), samples, optimizer, fixedEpochs(epochs, 1));
+                        });
+                        char id[128];
+                        snprintf(id, sizeof(id), "%s/s%d", shapeId(momentum ? "train_momentum" : "train_sgd",
+                            hidden, classes, neurons).c_str(), samples);
+                        report(id, "epochs_per_sec", 1.0 / seconds, true);
+                        report(id, "samples_per_sec", samples / seconds, true);
+                    }
+                    delete[] data;
+                }
+}
+
+static void benchParallelTraining(bool quick)
+{
+    fprintf(stderr, "parallel training, thread count sweep\n");
+    int samples = quick ? 4096 : 16384;
+    int hidden = 4, neurons = 32, classes = 4, batchSize = 256;
+    std::vector<float> raw;
+    std::vector<int> labels;
+    makeSamples(samples, classes, &raw, &labels);
+    float mean[2], variance[2];
+    float* data = Batch_Norm(raw.data(), samples, 2, mean, variance);
+
+    int hardware = DefaultThreadPool().ThreadCount();
+    std::vector<int> threadSweep;
+    for (int t = 1; t < hardware; t *= 2)
+        threadSweep.push_back(t);
+    threadSweep.push_back(hardware);
+
+    const TrainingParallelism modes[] = { TRAIN_SERIAL, TRAIN_SYNC, TRAIN_HOGWILD };
+    const char* names[] = { "train_serial", "train_sync", "train_hogwild" };
+    for (int m = 0; m < 3; m++)
+    {
+        double single = 0;
+        for (int threads : threadSweep)
+        {
+            if (modes[m] == TRAIN_SERIAL && threads > 1)
+                break;
+            ThreadPool pool(threads);
+            NeuralModel model;
+            initModel(model, hidden, neurons, classes);
+            AdamOptimizer optimizer(0.01f);
+            double seconds = timeRepeated([&](int epochs) {
+                TrainingConfig config = fixedEpochs(epochs, batchSize);
+                config.parallelism = modes[m];
+                config.pool = &pool;
+                model.Train(data, labels.data(), samples, optimizer, config);
+            });
+            char id[128];
+            snprintf(id, sizeof(id), "%s/b%d/t%d", shapeId(names[m], hidden, classes, neurons).c_str(), batchSize, threads);
+            report(id, "samples_per_sec", samples / seconds, true);
+            if (threads == 1)
+                single = seconds;
+            else
+                report(id, "speedup", single / seconds, true);
+        }
+    }
+    delete[] data;
+}
+
+static void benchInference(bool quick)
+{
+    fprintf(stderr, "inference (ExecuteTest over a decision map grid)\n");
+    std::vector<int> hiddenSweep = quick ? std::vector<int>{ 2, 7 } : std::vector<int>{ 2, 3, 4, 5, 6, 7 };
+    std::vector<int> classSweep = quick ? std::vector<int>{ 2, 7 } : std::vector<int>{ 2, 4, 7 };
+    std::vector<int> neuronSweep = quick ? std::vector<int>{ 8 } : std::vector<int>{ 4, 16, 64 };
+    int points = quick ? BENCH_GRID_POINTS / 4 : BENCH_GRID_POINTS;
+
+    std::vector<float> grid((size_t)points * 2);
+    for (int i = 0; i < points; i++)
+    {
+        grid[2 * i] = (float)(i % 256) / 64 - 2;
+        grid[2 * i + 1] = (float)(i / 256) / 64 - 2;
+    }
+    std::vector<int> predicted(points);
+
+    for (int hidden : hiddenSweep)
+        for (int classes : classSweep)
+            for (int neurons : neuronSweep)
+            {
+                NeuralModel model;
+                initModel(model, hidden, neurons, classes);
+                double seconds = timeRepeated([&](int reps) {
+                    for (int r = 0; r < reps; r++)
+                        model.ExecuteTest(grid.data(), predicted.data(), points);
+                });
+                report(shapeId("predict", hidden, classes, neurons), "ns_per_prediction", seconds * 1e9 / points, false);
+
+                seconds = timeRepeated([&](int reps) {
+                    for (int r = 0; r < reps; r++)
+                        model.ExecuteTestParallel(grid.data(), predicted.data(), points);
+                });
+                report(shapeId("predict_parallel", hidden, classes, neurons), "ns_per_prediction", seconds * 1e9 / points, false);
+
+                QuantizedModel quantized;
+                quantized.Quantize(model, grid.data(), points);
+                seconds = timeRepeated([&](int reps) {
+                    for (int r = 0; r < reps; r++)
+                        quantized.ExecuteTest(grid.data(), predicted.data(), points);
+                });
+                report(shapeId("predict_int8", hidden, classes, neurons), "ns_per_prediction", seconds * 1e9 / points, false);
+
+                const WeightPrecision precisions[] = { PRECISION_BF16, PRECISION_FP16 };
+                const char* precisionNames[] = { "predict_bf16", "predict_fp16" };
+                for (int p = 0; p < 2; p++)
+                {
+                    HalfPrecisionModel half;
+                    half.Convert(model, precisions[p]);
+                    seconds = timeRepeated([&](int reps) {
+                        for (int r = 0; r < reps; r++)
+                            half.ExecuteTest(grid.data(), predicted.data(), points);
+                    });
+                    report(shapeId(precisionNames[p], hidden, classes, neurons), "ns_per_prediction", seconds * 1e9 / points, false);
+                }
+
+                // Only the shapes CreateStaticClassifier instantiates
+                StaticClassifier* fast = CreateStaticClassifier(model);
+                if (fast != nullptr)
+                {
+                    seconds = timeRepeated([&](int reps) {
+                        for (int r = 0; r < reps; r++)
+                            fast->Predict(grid.data(), predicted.data(), points);
+                    });
+                    report(shapeId("predict_static", hidden, classes, neurons), "ns_per_prediction", seconds * 1e9 / points, false);
+                    delete fast;
+                }
+            }
+}
+
+// K members of one shape: one EnsembleModel pass against K ExecuteTest calls
+static void benchEnsemble(bool quick)
+{
+    fprintf(stderr, "ensemble inference (K models over a decision map grid)\n");
+    std::vector<int> memberSweep = quick ? std::vector<int>{ 4 } : std::vector<int>{ 2, 4, 8 };
+    int hidden = 2, classes = 4, neurons = quick ? 8 : 16;
+    int points = quick ? BENCH_GRID_POINTS / 4 : BENCH_GRID_POINTS;
+
+    std::vector<float> grid((size_t)points * 2);
+    for (int i = 0; i < points; i++)
+    {
+        grid[2 * i] = (float)(i % 256) / 64 - 2;
+        grid[2 * i + 1] = (float)(i / 256) / 64 - 2;
+    }
+    std::vector<int> predicted(points);
+    std::vector<int> units(hidden, neurons);
+
+    for (int k : memberSweep)
+    {
+        std::vector<NeuralModel> models(k);
+        std::vector<const NeuralModel*> members(k);
+        for (int m = 0; m < k; m++)
+        {
+            srand(m + 1);
+            models[m].InitializeModel(hidden, units.data(), 2, classes);
+            members[m] = &models[m];
+        }
+        char name[64];
+
+        double seconds = timeRepeated([&](int reps) {
+            for (int r = 0; r < reps; r++)
+                for (int m = 0; m < k; m++)
+                    models[m].ExecuteTest(grid.data(), predicted.data(), points);
+        });
+        snprintf(name, sizeof(name), "predict_ensemble_separate/k%d", k);
+        report(shapeId(name, hidden, classes, neurons), "ns_per_prediction", seconds * 1e9 / points, false);
+
+        EnsembleModel ensemble;
+        ensemble.Build(members.data(), k, ENSEMBLE_AVERAGE);
+        seconds = timeRepeated([&](int reps) {
+            for (int r = 0; r < reps; r++)
+                ensemble.ExecuteTest(grid.data(), predicted.data(), points);
+        });
+        snprintf(name, sizeof(name), "predict_ensemble/k%d", k);
+        report(shapeId(name, hidden, classes, neurons), "ns_per_prediction", seconds * 1e9 / points, false);
+    }
+}
+
+static void benchDataPreparation(bool quick)
+{
+    fprintf(stderr, "data preparation\n");
+    int samples = quick ? 100000 : 1000000;
+    std::vector<float> raw;
+    std::vector<int> labels;
+    makeSamples(samples, 4, &raw, &labels);
+    char id[64];
+
+    snprintf(id, sizeof(id), "batch_norm/s%d", samples);
+    double seconds = timeRepeated([&](int reps) {
+        for (int r = 0; r < reps; r++)
+        {
+            float mean[2], variance[2];
+            delete[] Batch_Norm(raw.data(), samples, 2, mean, variance);
+        }
+    });
+    report(id, "ns_per_sample", seconds * 1e9 / samples, false);
+
+    snprintf(id, sizeof(id), "feature_stats/s%d", samples);
+    seconds = timeRepeated([&](int reps) {
+        for (int r = 0; r < reps; r++)
+        {
+            FeatureStats stats(2);
+            stats.Add(raw.data(), samples);
+        }
+    });
+    report(id, "ns_per_sample", seconds * 1e9 / samples, false);
+
+    snprintf(id, sizeof(id), "normalize_in_place/s%d", samples);
+    std::vector<float> copy(raw);
+    float mean[2] = { 0, 0 }, invStd[2] = { 1, 1 };
+    seconds = timeRepeated([&](int reps) {
+        for (int r = 0; r < reps; r++)
+            NormalizeFeatures(copy.data(), copy.data(), samples, 2, mean, invStd);
+    });
+    report(id, "ns_per_sample", seconds * 1e9 / samples, false);
+
+    // Dataset::Add replaces the old Add_Data / Add_Labels pair
+    snprintf(id, sizeof(id), "dataset_add/s%d", samples);
+    seconds = timeRepeated([&](int reps) {
+        for (int r = 0; r < reps; r++)
+        {
+            Dataset data(2);
+            for (int i = 0; i < samples; i++)
+                data.Add(&raw[2 * (size_t)i], labels[i]);
+        }
+    });
+    report(id, "ns_per_sample", seconds * 1e9 / samples, false);
+
+    Dataset data(2);
+    for (int i = 0; i < samples; i++)
+        data.Add(&raw[2 * (size_t)i], labels[i]);
+    DatasetFileInfo info = { 2, 400, 300, 4 };
+    if (!SaveDataset(BENCH_SAMPLES_FILE, data, info))
+    {
+        fprintf(stderr, "  cannot write %s, skipping load_dataset\n", BENCH_SAMPLES_FILE);
+        return;
+    }
+    snprintf(id, sizeof(id), "load_dataset/s%d", samples);
+    seconds = timeRepeated([&](int reps) {
+        for (int r = 0; r < reps; r++)
+        {
+            Dataset loaded;
+            DatasetFileInfo loadedInfo;
+            LoadDataset(BENCH_SAMPLES_FILE, &loaded, &loadedInfo);
+        }
+    });
+    report(id, "samples_per_sec", samples / seconds, true);
+    remove(BENCH_SAMPLES_FILE);
+}
+
+static void benchWeightFiles(bool quick)
+{
+    fprintf(stderr, "weight files\n");
+    int hidden = 7, neurons = quick ? 64 : 256, classes = 7;
+    NeuralModel model;
+    initModel(model, hidden, neurons, classes);
+    std::string suffix = shapeId("", hidden, classes, neurons);
+
+    double seconds = timeRepeated([&](int reps) {
+        for (int r = 0; r < reps; r++)
+            model.SaveWeights(BENCH_WEIGHTS_FILE);
+    });
+    report("save_weights" + suffix, "us_per_call", seconds * 1e6, false);
+
+    NeuralModel loaded;
+    seconds = timeRepeated([&](int reps) {
+        for (int r = 0; r < reps; r++)
+            loaded.LoadWeights(BENCH_WEIGHTS_FILE);
+    });
+    report("load_weights" + suffix, "us_per_call", seconds * 1e6, false);
+
+    seconds = timeRepeated([&](int reps) {
+        for (int r = 0; r < reps; r++)
+            loaded.MapWeights(BENCH_WEIGHTS_FILE);
+    });
+    report("map_weights" + suffix, "us_per_call", seconds * 1e6, false);
+    loaded = NeuralModel(); // drop the mapping before the file is removed
+
+    seconds = timeRepeated([&](int reps) {
+        for (int r = 0; r < reps; r++)
+            model.ExportWeightsText(BENCH_WEIGHTS_FILE);
+    });
+    report("export_weights_text" + suffix, "us_per_call", seconds * 1e6, false);
+
+    seconds = timeRepeated([&](int reps) {
+        for (int r = 0; r < reps; r++)
+            loaded.ImportWeightsText(BENCH_WEIGHTS_FILE);
+    });
+    report("import_weights_text" + suffix, "us_per_call", seconds * 1e6, false);
+    remove(BENCH_WEIGHTS_FILE);
+}
+
+static void writeResults(FILE* out, bool quick)
+{
+    fprintf(out, "{\n  \"kernels\": \"%s\",\n  \"threads\": %d,\n  \"quick\": %s,\n  \"results\": [\n",
+        g_kernels.name, DefaultThreadPool().ThreadCount(), quick ? "true" : "false");
+    for (size_t i = 0; i < s_results.size(); i++)
+    {
+        const BenchResult& r = s_results[i];
+        fprintf(out, "    {\"id\": \"%s\", \"metric\": \"%s\", \"value\": %.6g, \"higher_is_better\": %s}%s\n",
+            r.id.c_str(), r.metric.c_str(), r.value, r.higherIsBetter ? "true" : "false",
+            (i + 1 < s_results.size()) ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// Value of "key": in a result line written by writeResults
+static bool findField(const std::string& line, const char* key, std::string* value)
+{
+    std::string pattern = std::string("\"") + key + "\": ";
+    size_t at = line.find(pattern);
+    if (at == std::string::npos)
+        return false;
+    at += pattern.size();
+    if (line[at] == '"')
+    {
+        size_t end = line.find('"', at + 1);
+        if (end == std::string::npos)
+            return false;
+        *value = line.substr(at + 1, end - at - 1);
+    }
+    else
+    {
+        size_t end = line.find_first_of(",}", at);
+        *value = line.substr(at, end - at);
+    }
+    return true;
+}
+
+static bool readBaseline(const char* path, std::vector<BenchResult>* baseline)
+{
+    FILE* file = fopen(path, "r");
+    if (file == nullptr)
+        return false;
+    char buffer[512];
+    while (fgets(buffer, sizeof(buffer), file) != nullptr)
+    {
+        std::string line(buffer), id, metric, value, higher;
+        if (!findField(line, "id", &id) || !findField(line, "metric", &metric) || !findField(line, "value", &value)
+            || !findField(line, "higher_is_better", &higher))
+            continue;
+        BenchResult result;
+        result.id = id;
+        result.metric = metric;
+        result.value = atof(value.c_str());
+        result.higherIsBetter = higher == "true";
+        baseline->push_back(result);
+    }
+    fclose(file);
+    return true;
+}
+
+// Returns the number of results more than tolerance worse than the baseline
+static int compareBaseline(const std::vector<BenchResult>& baseline, double tolerance)
+{
+    int regressions = 0, compared = 0;
+    fprintf(stderr, "baseline comparison (tolerance %.0f%%)\n", tolerance * 100);
+    for (const BenchResult& r : s_results)
+    {
+        for (const BenchResult& b : baseline)
+        {
+            if (b.id != r.id || b.metric != r.metric || b.value <= 0 || r.value <= 0)
+                continue;
+            // > 1 means better than the baseline
+            double ratio = r.higherIsBetter ? r.value / b.value : b.value / r.value;
+            compared++;
+            if (ratio < 1 - tolerance)
+            {
+                regressions++;
+                fprintf(stderr, "  REGRESSION %-44s %s %.4g -> %.4g (%.0f%%)\n", r.id.c_str(), r.metric.c_str(),
+                    b.value, r.value, (ratio - 1) * 100);
+            }
+            break;
+        }
+    }
+    fprintf(stderr, "  %d results compared, %d regressions\n", compared, regressions);
+    return regressions;
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = false;
+    const char* outPath = nullptr;
+    const char* baselinePath = nullptr;
+    double tolerance = BENCH_TOLERANCE;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--quick") == 0)
+            quick = true;
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            outPath = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+            baselinePath = argv[++i];
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+            tolerance = atof(argv[++i]);
+        else if (strcmp(argv[i], "--kernels") == 0 && i + 1 < argc)
+        {
+            const char* names[] = { "scalar", "sse2", "avx2", "avx512" };
+            for (int level = 0; level < 4; level++)
+                if (strcmp(argv[i + 1], names[level]) == 0)
+                    SelectKernels((KernelLevel)level);
+            i++;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--quick] [--out results.json] [--baseline baseline.json] [--tolerance 0.15]"
+                " [--kernels scalar|sse2|avx2|avx512]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (quick)
+        s_minSeconds = BENCH_QUICK_SECONDS;
+
+    std::vector<BenchResult> baseline;
+    if (baselinePath != nullptr && !readBaseline(baselinePath, &baseline))
+    {
+        fprintf(stderr, "cannot read baseline %s\n", baselinePath);
+        return 2;
+    }
+
+    fprintf(stderr, "kernels: %s, threads: %d\n", g_kernels.name, DefaultThreadPool().ThreadCount());
+    benchTraining(quick);
+    benchParallelTraining(quick);
+    benchInference(quick);
+    benchEnsemble(quick);
+    benchDataPreparation(quick);
+    benchWeightFiles(quick);
+
+    FILE* out = (outPath != nullptr) ? fopen(outPath, "w") : stdout;
+    if (out == nullptr)
+    {
+        fprintf(stderr, "cannot write %s\n", outPath);
+        return 2;
+    }
+    writeResults(out, quick);
+    if (out != stdout)
+        fclose(out);
+
+    if (baselinePath != nullptr && compareBaseline(baseline, tolerance) > 0)
+        return 1;
+    return 0;
+}
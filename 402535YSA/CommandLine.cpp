@@ -0,0 +1,510 @@
+// Headless trainer and predictor (ysa, CMakeLists.txt) on top of the ysacore
+// library: no Windows Forms and no UI thread, so long training runs can go
+// to a server.
+//
+//   ysa train <samples> <weights> [options]    sample file as the UI saves it
+//   ysa predict <weights> <features> [options] one class per line
+//   ysa evaluate <weights> <samples> [options] accuracy on labelled samples
+//   ysa sweep <samples> <weights> [options]    hyperparameter search, saves the best
+
+#include "pch.h"
+#include "NeuralNetwork.h"
+#include "Optimizer.h"
+#include "Dataset.h"
+#include "Normalization.h"
+#include "QuantizedModel.h"
+#include "HalfPrecisionModel.h"
+#include "ThreadPool.h"
+#include "Kernels.h"
+#include "TrainingConfig.h"
+#include "Telemetry.h"
+#include "HyperparameterSweep.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define CLI_DEFAULT_HIDDEN 8
+
+static const char* s_usage =
+    "usage:\n"
+    "  ysa train <samples> <weights> [--hidden 8,8] [--optimizer SGD|SGDwMomentum|Nesterov|RMSProp|Adam]\n"
+    "            [--batch 1] [--epochs 30000] [--target 0.01] [--parallel serial|sync|hogwild] [--threads 0]\n"
+    "            [--validation 0] [--patience 0] [--time 0] [--seed 1] [--text] [--report 0] [--time-layers]\n"
+    "            [--precision fp32|bf16|fp16]\n"
+    "  ysa predict <weights> <features> [--out labels.txt] [--int8 | --precision bf16|fp16] [--text]\n"
+    "  ysa evaluate <weights> <samples> [--int8 | --precision bf16|fp16] [--text]\n"
+    "  ysa sweep <samples> <weights> [--shapes 4/8,8/16,16] [--optimizers SGD,Adam] [--rates 0.01,0.1]\n"
+    "            [--batches 1,32] [--trials 0] [--min-epochs 100] [--max-epochs 2700] [--eta 3]\n"
+    "            [--validation 0.2] [--top 10] [--threads 0] [--seed 1] [--text]\n"
+    "common: [--kernels scalar|sse2|avx2|avx512]\n";
+
+struct CliOptions
+{
+    CliOptions();
+
+    std::vector<int> hidden;
+    OptimizerType optimizer;
+    TrainingConfig config;
+    int threads;                // 0 = one per hardware thread
+    unsigned int seed;
+    int reportInterval;         // progress lines every this many epochs, 0 = none
+    bool text;                  // weights as ExportWeightsText writes them
+    bool int8;                  // predict with a QuantizedModel
+    const char* outPath;        // stdout if null
+    SweepSpace space;
+    SweepConfig sweep;
+    int top;                    // sweep results printed
+};
+
+CliOptions::CliOptions()
+{
+    optimizer = OPTIMIZER_SGD;
+    threads = 0;
+    seed = 1;
+    reportInterval = 0;
+    text = false;
+    int8 = false;
+    outPath = nullptr;
+    top = 10;
+}
+
+// "16,8" -> { 16, 8 }
+static bool parseHidden(const char* text, std::vector<int>* hidden)
+{
+    hidden->clear();
+    for (;;)
+    {
+        char* end;
+        long units = strtol(text, &end, 10);
+        if (end == text || units <= 0 || (*end != ',' && *end != '\0'))
+            return false;
+        hidden->push_back((int)units);
+        if (*end == '\0')
+            return true;
+        text = end + 1;
+    }
+}
+
+// "4/8,8" -> shapes { 4 } and { 8, 8 }
+static bool parseShapes(const char* text, SweepSpace* space)
+{
+    std::string list(text);
+    size_t start = 0;
+    for (;;)
+    {
+        size_t end = list.find('/', start);
+        std::vector<int> hidden;
+        if (!parseHidden(list.substr(start, end - start).c_str(), &hidden)
+            || !space->AddShape((int)hidden.size(), hidden.data()))
+            return false;
+        if (end == std::string::npos)
+            return true;
+        start = end + 1;
+    }
+}
+
+// Comma separated optimizer names, learning rates or batch sizes
+static bool parseChoices(const char* name, const char* text, SweepSpace* space)
+{
+    std::string list(text);
+    size_t start = 0;
+    for (;;)
+    {
+        size_t end = list.find(',', start);
+        std::string item = list.substr(start, end - start);
+        OptimizerType optimizer;
+        bool added;
+        if (strcmp(name, "--optimizers") == 0)
+            added = OptimizerFromName(item.c_str(), &optimizer) && space->AddOptimizer(optimizer);
+        else if (strcmp(name, "--rates") == 0)
+            added = space->AddLearningRate((float)atof(item.c_str()));
+        else
+            added = space->AddBatchSize(atoi(item.c_str()));
+        if (!added)
+            return false;
+        if (end == std::string::npos)
+            return true;
+        start = end + 1;
+    }
+}
+
+static bool parseOptions(int argc, char** argv, int first, CliOptions* options)
+{
+    for (int i = first; i < argc; i++)
+    {
+        const char* name = argv[i];
+        if (strcmp(name, "--text") == 0)
+            options->text = true;
+        else if (strcmp(name, "--int8") == 0)
+            options->int8 = true;
+        else if (strcmp(name, "--time-layers") == 0)
+            options->config.timeLayers = true;
+        else if (i + 1 >= argc)
+            return false;
+        else
+        {
+            const char* value = argv[++i];
+            if (strcmp(name, "--hidden") == 0)
+            {
+                if (!parseHidden(value, &options->hidden))
+                    return false;
+            }
+            else if (strcmp(name, "--optimizer") == 0)
+            {
+                if (!OptimizerFromName(value, &options->optimizer))
+                    return false;
+            }
+            else if (strcmp(name, "--parallel") == 0)
+            {
+                if (strcmp(value, "serial") == 0)
+                    options->config.parallelism = TRAIN_SERIAL;
+                else if (strcmp(value, "sync") == 0)
+                    options->config.parallelism = TRAIN_SYNC;
+                else if (strcmp(value, "hogwild") == 0)
+                    options->config.parallelism = TRAIN_HOGWILD;
+                else
+                    return false;
+            }
+            else if (strcmp(name, "--precision") == 0)
+            {
+                // train: mixed precision; predict / evaluate: HalfPrecisionModel
+                if (strcmp(value, "fp32") == 0)
+                    options->config.weightPrecision = PRECISION_FP32;
+                else if (strcmp(value, "bf16") == 0)
+                    options->config.weightPrecision = PRECISION_BF16;
+                else if (strcmp(value, "fp16") == 0)
+                    options->config.weightPrecision = PRECISION_FP16;
+                else
+                    return false;
+            }
+            else if (strcmp(name, "--shapes") == 0)
+            {
+                if (!parseShapes(value, &options->space))
+                    return false;
+            }
+            else if (strcmp(name, "--optimizers") == 0 || strcmp(name, "--rates") == 0 || strcmp(name, "--batches") == 0)
+            {
+                if (!parseChoices(name, value, &options->space))
+                    return false;
+            }
+            else if (strcmp(name, "--kernels") == 0)
+            {
+                const char* names[] = { "scalar", "sse2", "avx2", "avx512" };
+                int level = 0;
+                while (level < 4 && strcmp(value, names[level]) != 0)
+                    level++;
+                if (level == 4)
+                    return false;
+                SelectKernels((KernelLevel)level);
+            }
+            else if (strcmp(name, "--batch") == 0)
+                options->config.batchSize = atoi(value);
+            else if (strcmp(name, "--epochs") == 0)
+                options->config.maxEpochs = atoi(value);
+            else if (strcmp(name, "--target") == 0)
+                options->config.targetError = (float)atof(value);
+            else if (strcmp(name, "--threads") == 0)
+                options->threads = atoi(value);
+            else if (strcmp(name, "--validation") == 0)
+                options->config.validationFraction = (float)atof(value);
+            else if (strcmp(name, "--patience") == 0)
+                options->config.patience = atoi(value);
+            else if (strcmp(name, "--time") == 0)
+                options->config.timeBudgetSeconds = atof(value);
+            else if (strcmp(name, "--report") == 0)
+                options->reportInterval = atoi(value);
+            else if (strcmp(name, "--seed") == 0)
+                options->seed = (unsigned int)strtoul(value, nullptr, 10);
+            else if (strcmp(name, "--out") == 0)
+                options->outPath = value;
+            else if (strcmp(name, "--trials") == 0)
+                options->sweep.randomTrials = atoi(value);
+            else if (strcmp(name, "--min-epochs") == 0)
+                options->sweep.minEpochs = atoi(value);
+            else if (strcmp(name, "--max-epochs") == 0)
+                options->sweep.maxEpochs = atoi(value);
+            else if (strcmp(name, "--eta") == 0)
+                options->sweep.eta = atoi(value);
+            else if (strcmp(name, "--top") == 0)
+                options->top = atoi(value);
+            else
+                return false;
+        }
+    }
+    return options->config.batchSize > 0 && options->config.maxEpochs > 0 && options->threads >= 0;
+}
+
+// One progress line per report; with layer timers, the phase totals and
+// the layer that took the longest
+class ProgressPrinter : public TrainingTelemetry
+{
+public:
+    void OnReport(const EpochTelemetry& report)
+    {
+        fprintf(stderr, "epoch %6d  rmse %.5f", report.epoch + 1, report.trainError);
+        if (report.validationError >= 0)
+            fprintf(stderr, "  val %.5f", report.validationError);
+        fprintf(stderr, "  lr %.4g  %.1f s  %.0f samples/s", report.learningRate, report.elapsedSeconds,
+            report.samplesPerSecond);
+        if (report.forwardNanos != nullptr)
+        {
+            long long forward = 0, backward = 0, update = 0, slowestTime = -1;
+            int slowest = 0;
+            for (int l = 0; l < report.layerCount; l++)
+            {
+                forward += report.forwardNanos[l];
+                backward += report.backwardNanos[l];
+                update += report.updateNanos[l];
+                long long layerTime = report.forwardNanos[l] + report.backwardNanos[l] + report.updateNanos[l];
+                if (layerTime > slowestTime)
+                {
+                    slowestTime = layerTime;
+                    slowest = l;
+                }
+            }
+            long long total = forward + backward + update;
+            fprintf(stderr, "  fwd/bwd/upd %.0f/%.0f/%.0f ms  layer %d %.0f%%", forward * 1e-6, backward * 1e-6,
+                update * 1e-6, slowest, total > 0 ? 100.0 * slowestTime / total : 0.0);
+        }
+        fputc('\n', stderr);
+    }
+};
+
+static bool loadModel(const char* path, bool text, NeuralModel* model)
+{
+    bool loaded = text ? model->ImportWeightsText(path) : model->MapWeights(path);
+    if (!loaded)
+        fprintf(stderr, "cannot read weights %s\n", path);
+    return loaded;
+}
+
+static void predictAll(const NeuralModel& model, const Dataset& data, const CliOptions& options, int* predicted)
+{
+    if (options.int8)
+    {
+        // The samples themselves set the activation ranges
+        QuantizedModel quantized;
+        quantized.Quantize(model, data.Features(), data.Count());
+        quantized.ExecuteTestParallel(data.Features(), predicted, data.Count());
+    }
+    else if (options.config.weightPrecision != PRECISION_FP32)
+    {
+        HalfPrecisionModel half;
+        half.Convert(model, options.config.weightPrecision);
+        half.ExecuteTestParallel(data.Features(), predicted, data.Count());
+    }
+    else
+        model.ExecuteTestParallel(data.Features(), predicted, data.Count());
+}
+
+static int countCorrect(const NeuralModel& model, const Dataset& data)
+{
+    std::vector<int> predicted(data.Count());
+    model.ExecuteTestParallel(data.Features(), predicted.data(), data.Count());
+    int correct = 0;
+    for (int i = 0; i < data.Count(); i++)
+        correct += (predicted[i] == data.Label(i));
+    return correct;
+}
+
+// Sample file with at least one sample; the class count covers every label
+static bool loadSamples(const char* path, Dataset* data, int* classCount)
+{
+    DatasetFileInfo info;
+    if (!LoadDataset(path, data, &info) || data->Count() == 0)
+    {
+        fprintf(stderr, "cannot read samples %s\n", path);
+        return false;
+    }
+    *classCount = info.classCount;
+    for (int i = 0; i < data->Count(); i++)
+    {
+        if (data->Label(i) < 0)
+        {
+            fprintf(stderr, "sample %d has label %d\n", i, data->Label(i));
+            return false;
+        }
+        if (data->Label(i) >= *classCount)
+            *classCount = data->Label(i) + 1;
+    }
+    return true;
+}
+
+static bool saveModel(const NeuralModel& model, const char* path, bool text)
+{
+    bool saved = text ? model.ExportWeightsText(path) : model.SaveWeights(path);
+    if (!saved)
+        fprintf(stderr, "cannot write weights %s\n", path);
+    return saved;
+}
+
+static int runTrain(const char* samplesPath, const char* weightsPath, CliOptions& options)
+{
+    Dataset data;
+    int classCount;
+    if (!loadSamples(samplesPath, &data, &classCount))
+        return 2;
+
+    if (options.hidden.empty())
+        options.hidden.assign(1, CLI_DEFAULT_HIDDEN);
+    NeuralModel model;
+    srand(options.seed);
+    model.InitializeModel((int)options.hidden.size(), options.hidden.data(), data.Dimension(), classCount);
+
+    FeatureStats stats(data.Dimension());
+    stats.Add(data.Features(), data.Count());
+    std::vector<float> mean(data.Dimension()), variance(data.Dimension());
+    stats.Export(mean.data(), variance.data());
+    model.AttachInputNormalization(mean.data(), variance.data());
+
+    ThreadPool pool(options.threads);
+    options.config.pool = &pool;
+    options.config.shuffleSeed = options.seed;
+    Optimizer* optimizer = CreateOptimizer(options.optimizer);
+    ProgressPrinter progress;
+    if (options.reportInterval > 0)
+    {
+        options.config.telemetry = &progress;
+        options.config.reportInterval = options.reportInterval;
+    }
+
+    fprintf(stderr, "%d samples, %d features, %d classes, %d parameters, %s, %d threads, %s kernels\n",
+        data.Count(), data.Dimension(), classCount, (int)model.ParameterCount(), optimizer->Name(), pool.ThreadCount(),
+        g_kernels.name);
+    double start = MonotonicSeconds();
+    TrainingResult result = model.Train(data.Features(), data.Labels(), data.Count(), *optimizer, options.config);
+    double seconds = MonotonicSeconds() - start;
+    delete optimizer;
+
+    const char* reasons[] = { "target error", "max epochs", "no improvement", "time budget", "cancelled" };
+    fprintf(stderr, "stopped after %d epochs (%s) in %.2f s, %.0f samples/s\n", result.lastEpoch + 1,
+        reasons[result.reason], seconds, (double)data.Count() * (result.lastEpoch + 1) / seconds);
+    fprintf(stderr, "train RMSE %.5f, best %.5f at epoch %d", result.trainError, result.bestError, result.bestEpoch + 1);
+    if (result.validationError >= 0)
+        fprintf(stderr, ", validation RMSE %.5f", result.validationError);
+    int correct = countCorrect(model, data);
+    fprintf(stderr, "\ntraining accuracy %.2f%% (%d / %d)\n", 100.0 * correct / data.Count(), correct, data.Count());
+
+    return saveModel(model, weightsPath, options.text) ? 0 : 2;
+}
+
+// Ranked table of the trials on stdout, the best model to weightsPath
+static int runSweep(const char* samplesPath, const char* weightsPath, CliOptions& options)
+{
+    Dataset data;
+    int classCount;
+    if (!loadSamples(samplesPath, &data, &classCount))
+        return 2;
+
+    ThreadPool pool(options.threads);
+    SweepConfig& sweep = options.sweep;
+    sweep.training = options.config;
+    sweep.seed = options.seed;
+    sweep.pool = &pool;
+    if (options.config.validationFraction > 0)
+        sweep.validationFraction = options.config.validationFraction;
+
+    HyperparameterSweep search;
+    double start = MonotonicSeconds();
+    if (!search.Run(options.space, data.Features(), data.Labels(), data.Count(), data.Dimension(), classCount, sweep))
+    {
+        fprintf(stderr, "nothing to sweep\n");
+        return 2;
+    }
+    fprintf(stderr, "%d trials on %d threads in %.2f s\n", search.TrialCount(), pool.ThreadCount(),
+        MonotonicSeconds() - start);
+
+    const char* optimizerNames[] = { "SGD", "SGDwMomentum", "Nesterov", "RMSProp", "Adam" };
+    const char* reasons[] = { "target", "epochs", "patience", "time", "cancelled" };
+    printf("rank  hidden        optimizer     rate      batch  epochs  val rmse  train rmse  seconds  status\n");
+    for (int rank = 0; rank < search.TrialCount() && rank < options.top; rank++)
+    {
+        const SweepResult& result = search.Result(rank);
+        std::string hidden;
+        for (int l = 0; l < result.trial.layerCount; l++)
+            hidden += (l > 0 ? "," : "") + std::to_string(result.trial.units[l]);
+        std::string status = result.pruned ? "pruned at rung " + std::to_string(result.rung) : reasons[result.reason];
+        printf("%4d  %-12s  %-12s  %-8.4g  %5d  %6d  %8.5f  %10.5f  %7.2f  %s\n", rank + 1, hidden.c_str(),
+            optimizerNames[result.trial.optimizer], result.trial.learningRate, result.trial.batchSize, result.epochs,
+            result.validationError, result.trainError, result.seconds, status.c_str());
+    }
+    return saveModel(search.Model(0), weightsPath, options.text) ? 0 : 2;
+}
+
+static int runPredict(const char* weightsPath, const char* featuresPath, const CliOptions& options)
+{
+    NeuralModel model;
+    if (!loadModel(weightsPath, options.text, &model))
+        return 2;
+    Dataset data;
+    if (!LoadFeatures(featuresPath, model.InputDimension(), &data))
+    {
+        fprintf(stderr, "cannot read features %s\n", featuresPath);
+        return 2;
+    }
+
+    std::vector<int> predicted(data.Count());
+    double start = MonotonicSeconds();
+    predictAll(model, data, options, predicted.data());
+    double seconds = MonotonicSeconds() - start;
+    fprintf(stderr, "%d samples in %.3f s (%.1f ns/sample)\n", data.Count(), seconds,
+        data.Count() > 0 ? seconds * 1e9 / data.Count() : 0.0);
+
+    FILE* out = (options.outPath != nullptr) ? fopen(options.outPath, "w") : stdout;
+    if (out == nullptr)
+    {
+        fprintf(stderr, "cannot write %s\n", options.outPath);
+        return 2;
+    }
+    for (int i = 0; i < data.Count(); i++)
+        fprintf(out, "%d\n", predicted[i]);
+    bool written = !ferror(out);
+    if (out != stdout)
+        written = (fclose(out) == 0) && written;
+    return written ? 0 : 2;
+}
+
+static int runEvaluate(const char* weightsPath, const char* samplesPath, const CliOptions& options)
+{
+    NeuralModel model;
+    if (!loadModel(weightsPath, options.text, &model))
+        return 2;
+    Dataset data;
+    DatasetFileInfo info;
+    if (!LoadDataset(samplesPath, &data, &info) || data.Dimension() != model.InputDimension())
+    {
+        fprintf(stderr, "cannot read samples %s with %d features\n", samplesPath, model.InputDimension());
+        return 2;
+    }
+
+    std::vector<int> predicted(data.Count());
+    predictAll(model, data, options, predicted.data());
+    int correct = 0;
+    for (int i = 0; i < data.Count(); i++)
+        correct += (predicted[i] == data.Label(i));
+    printf("accuracy %.2f%% (%d / %d)\n", data.Count() > 0 ? 100.0 * correct / data.Count() : 0.0, correct,
+        data.Count());
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    CliOptions options;
+    if (argc < 4 || !parseOptions(argc, argv, 4, &options))
+    {
+        fputs(s_usage, stderr);
+        return 1;
+    }
+    if (strcmp(argv[1], "train") == 0)
+        return runTrain(argv[2], argv[3], options);
+    if (strcmp(argv[1], "predict") == 0)
+        return runPredict(argv[2], argv[3], options);
+    if (strcmp(argv[1], "evaluate") == 0)
+        return runEvaluate(argv[2], argv[3], options);
+    if (strcmp(argv[1], "sweep") == 0)
+        return runSweep(argv[2], argv[3], options);
+    fputs(s_usage, stderr);
+    return 1;
+}
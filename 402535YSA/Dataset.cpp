@@ -0,0 +1,227 @@
+#include "pch.h"
+#include "Dataset.h"
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+// Bytes read from the sample file per call
+#define DATASET_CHUNK_SIZE (1 << 20)
+#define DATASET_MIN_CAPACITY 64
+
+Dataset::Dataset(int dimension)
+{
+    features = nullptr;
+    labels = nullptr;
+    count = 0;
+    capacity = 0;
+    this->dimension = dimension;
+}
+
+Dataset::Dataset(const Dataset& other)
+{
+    features = nullptr;
+    labels = nullptr;
+    count = 0;
+    capacity = 0;
+    dimension = 0;
+    *this = other;
+}
+
+Dataset& Dataset::operator=(const Dataset& other)
+{
+    if (this == &other)
+        return *this;
+    Reset(other.dimension);
+    Reserve(other.count);
+    if (other.count > 0)
+    {
+        memcpy(features, other.features, (size_t)other.count * dimension * sizeof(float));
+        memcpy(labels, other.labels, (size_t)other.count * sizeof(int));
+    }
+    count = other.count;
+    return *this;
+}
+
+Dataset::~Dataset()
+{
+    delete[] features;
+    delete[] labels;
+}
+
+void Dataset::Reset(int dimension)
+{
+    if (dimension != this->dimension)
+    {
+        delete[] features;
+        delete[] labels;
+        features = nullptr;
+        labels = nullptr;
+        capacity = 0;
+        this->dimension = dimension;
+    }
+    count = 0;
+}
+
+void Dataset::Reserve(int sampleCount)
+{
+    if (sampleCount <= capacity)
+        return;
+    float* newFeatures = new float[(size_t)sampleCount * dimension];
+    int* newLabels = new int[sampleCount];
+    if (count > 0)
+    {
+        memcpy(newFeatures, features, (size_t)count * dimension * sizeof(float));
+        memcpy(newLabels, labels, (size_t)count * sizeof(int));
+    }
+    delete[] features;
+    delete[] labels;
+    features = newFeatures;
+    labels = newLabels;
+    capacity = sampleCount;
+}
+
+void Dataset::Add(const float* x, int label)
+{
+    if (count == capacity)
+        Reserve(capacity < DATASET_MIN_CAPACITY ? DATASET_MIN_CAPACITY : capacity * 2);
+    memcpy(features + (size_t)count * dimension, x, dimension * sizeof(float));
+    labels[count] = label;
+    count++;
+}
+
+// Splits a stream into whitespace separated tokens, refilling a fixed
+// buffer chunk by chunk. A token cut by the end of a chunk is moved to the
+// front of the buffer before the next read.
+class TokenReader
+{
+public:
+    explicit TokenReader(std::ifstream& file) : file(file), buffer(DATASET_CHUNK_SIZE), begin(0), end(0), eof(false) {}
+
+    bool Next(const char** first, const char** last)
+    {
+        for (;;)
+        {
+            while (begin < end && isSpace(buffer[begin]))
+                begin++;
+            size_t tokenEnd = begin;
+            while (tokenEnd < end && !isSpace(buffer[tokenEnd]))
+                tokenEnd++;
+
+            if (tokenEnd < end || (eof && tokenEnd > begin))
+            {
+                *first = buffer.data() + begin;
+                *last = buffer.data() + tokenEnd;
+                begin = tokenEnd;
+                return true;
+            }
+            if (eof || !refill())
+                return false;
+        }
+    }
+private:
+    static bool isSpace(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+    bool refill()
+    {
+        size_t kept = end - begin;
+        if (kept == buffer.size())
+            return false; // one token larger than a whole chunk
+        memmove(buffer.data(), buffer.data() + begin, kept);
+        begin = 0;
+        end = kept;
+        file.read(buffer.data() + end, buffer.size() - end);
+        size_t got = (size_t)file.gcount();
+        end += got;
+        if (got == 0 || !file)
+            eof = true;
+        return true;
+    }
+
+    std::ifstream& file;
+    std::vector<char> buffer;
+    size_t begin, end;
+    bool eof;
+};
+
+template <typename T>
+static bool parseToken(TokenReader& reader, T* value)
+{
+    const char* first;
+    const char* last;
+    if (!reader.Next(&first, &last))
+        return false;
+    std::from_chars_result result = std::from_chars(first, last, *value);
+    return result.ec == std::errc() && result.ptr == last;
+}
+
+bool LoadDataset(const char* path, Dataset* data, DatasetFileInfo* info)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    TokenReader reader(file);
+    DatasetFileInfo header;
+    if (!parseToken(reader, &header.dimension) || !parseToken(reader, &header.width)
+        || !parseToken(reader, &header.height) || !parseToken(reader, &header.classCount)
+        || header.dimension <= 0)
+        return false;
+
+    data->Reset(header.dimension);
+    std::vector<float> x(header.dimension);
+    for (;;)
+    {
+        int i = 0;
+        while (i < header.dimension && parseToken(reader, &x[i]))
+            i++;
+        // Labels were written as floats by older versions
+        float label;
+        if (i < header.dimension || !parseToken(reader, &label))
+            break;
+        data->Add(x.data(), (int)label);
+    }
+
+    *info = header;
+    return true;
+}
+
+bool LoadFeatures(const char* path, int dimension, Dataset* data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open() || dimension <= 0)
+        return false;
+
+    TokenReader reader(file);
+    data->Reset(dimension);
+    std::vector<float> x(dimension);
+    for (;;)
+    {
+        int i = 0;
+        while (i < dimension && parseToken(reader, &x[i]))
+            i++;
+        if (i < dimension)
+            break;
+        data->Add(x.data(), -1);
+    }
+    return true;
+}
+
+bool SaveDataset(const char* path, const Dataset& data, const DatasetFileInfo& info)
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+        return false;
+
+    file.precision(std::numeric_limits<float>::max_digits10);
+    file << info.dimension << " " << info.width << " " << info.height << " " << info.classCount << "\n";
+    for (int i = 0; i < data.Count(); i++)
+    {
+        const float* x = data.Sample(i);
+        for (int d = 0; d < data.Dimension(); d++)
+            file << x[d] << " ";
+        file << data.Label(i) << "\n";
+    }
+    return file.good();
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+
+// Samples as one contiguous row-major feature matrix (Count() x Dimension())
+// and an integer label per sample. Storage grows geometrically, so adding n
+// samples costs O(n) copies in total.
+class Dataset
+{
+public:
+    explicit Dataset(int dimension = 0);
+    Dataset(const Dataset& other);
+    Dataset& operator=(const Dataset& other);
+    ~Dataset();
+
+    // Drops all samples and switches to a new feature dimension
+    void Reset(int dimension);
+    void Clear() { count = 0; }
+    // Makes room for at least sampleCount samples without reallocating
+    void Reserve(int sampleCount);
+    void Add(const float* features, int label);
+
+    int Count() const { return count; }
+    int Dimension() const { return dimension; }
+    float* Features() { return features; }
+    const float* Features() const { return features; }
+    const float* Sample(int i) const { return features + (size_t)i * dimension; }
+    const int* Labels() const { return labels; }
+    int Label(int i) const { return labels[i]; }
+private:
+    float* features;
+    int* labels;
+    int count;
+    int capacity;
+    int dimension;
+};
+
+// First line of a sample file: dimension, half width and half height of
+// the drawing area, class count
+struct DatasetFileInfo
+{
+    int dimension;
+    int width;
+    int height;
+    int classCount;
+};
+
+// Reads a sample file (header line, then dimension features and a label per
+// sample) in large chunks. Parsing stops at the first incomplete sample.
+// Returns false if the file cannot be opened or the header is malformed.
+bool LoadDataset(const char* path, Dataset* data, DatasetFileInfo* info);
+bool SaveDataset(const char* path, const Dataset& data, const DatasetFileInfo& info);
+
+// Reads a feature file for batch prediction: dimension features per sample,
+// whitespace separated, without header or labels (every label is -1).
+// Parsing stops at the first incomplete sample. Returns false if the file
+// cannot be opened.
+bool LoadFeatures(const char* path, int dimension, Dataset* data);
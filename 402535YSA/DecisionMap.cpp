@@ -0,0 +1,250 @@
+#include "pch.h"
+#include "DecisionMap.h"
+#include "NeuralNetwork.h"
+#include "StaticNetwork.h"
+#include "ThreadPool.h"
+#include <vector>
+
+// Lattice coordinates along one axis: 0, tile, 2 * tile, ..., size - 1
+static std::vector<int> latticeAxis(int size, int tileSize)
+{
+    std::vector<int> axis;
+    for (int p = 0; p < size - 1; p += tileSize)
+        axis.push_back(p);
+    axis.push_back(size - 1);
+    return axis;
+}
+
+// Refines one coarse tile inside a private (tileSize + 1)^2 label block, so
+// tiles can run on different threads without sharing evaluated pixels
+struct TileRefiner
+{
+    const NeuralModel* model;
+    const StaticClassifier* fast;   // specialization of model, may be null
+    const DecisionMapGrid* grid;
+    InferenceWorkspace* workspace;
+    int* block;             // -1 = not evaluated yet
+    int stride;
+    int originCol, originRow;
+    const int* probes;      // x, y pairs inside this tile
+    int probeCount;
+    long long evaluations;
+
+    int& at(int x, int y) { return block[y * stride + x]; }
+
+    void evaluate(int x, int y)
+    {
+        if (at(x, y) >= 0)
+            return;
+        float input[2];
+        input[0] = grid->originX + (originCol + x) * grid->stepX;
+        input[1] = grid->originY + (originRow + y) * grid->stepY;
+        if (fast != nullptr)
+            fast->Predict(input, &at(x, y), 1);
+        else
+            model->Predict(input, &at(x, y), 1, *workspace);
+        evaluations++;
+    }
+
+    bool holdsProbe(int x0, int y0, int x1, int y1) const
+    {
+        for (int p = 0; p < probeCount; p++)
+        {
+            int x = probes[2 * p] - originCol;
+            int y = probes[2 * p + 1] - originRow;
+            if (x >= x0 && x <= x1 && y >= y0 && y <= y1)
+                return true;
+        }
+        return false;
+    }
+
+    // Closed rectangle [x0, x1] x [y0, y1] with evaluated corners
+    void refine(int x0, int y0, int x1, int y1)
+    {
+        if (x1 - x0 <= 1 && y1 - y0 <= 1)
+            return; // every pixel is a corner
+
+        int label = at(x0, y0);
+        if (at(x1, y0) == label && at(x0, y1) == label && at(x1, y1) == label && !holdsProbe(x0, y0, x1, y1))
+        {
+            for (int y = y0; y <= y1; y++)
+                for (int x = x0; x <= x1; x++)
+                    if (at(x, y) < 0)
+                        at(x, y) = label;
+            return;
+        }
+
+        bool splitX = x1 - x0 >= 2;
+        bool splitY = y1 - y0 >= 2;
+        int xm = (x0 + x1) / 2;
+        int ym = (y0 + y1) / 2;
+        if (splitX && splitY)
+        {
+            evaluate(xm, y0);
+            evaluate(x0, ym);
+            evaluate(xm, ym);
+            evaluate(x1, ym);
+            evaluate(xm, y1);
+            refine(x0, y0, xm, ym);
+            refine(xm, y0, x1, ym);
+            refine(x0, ym, xm, y1);
+            refine(xm, ym, x1, y1);
+        }
+        else if (splitX)
+        {
+            evaluate(xm, y0);
+            evaluate(xm, y1);
+            refine(x0, y0, xm, y1);
+            refine(xm, y0, x1, y1);
+        }
+        else
+        {
+            evaluate(x0, ym);
+            evaluate(x1, ym);
+            refine(x0, y0, x1, ym);
+            refine(x0, ym, x1, y1);
+        }
+    }
+};
+
+long long ClassifyDecisionMap(const NeuralModel& model, const DecisionMapGrid& grid, int* labels,
+    const int* probePixels, int probeCount, int tileSize)
+{
+    // Every input built below is an (x, y) pair
+    if (model.InputDimension() != 2)
+        return -1;
+    int width = grid.width, height = grid.height;
+    if (tileSize < 2)
+        tileSize = 2;
+    if (width < 2 || height < 2)
+    {
+        ClassifyDecisionMapDense(model, grid, labels);
+        return (long long)width * height;
+    }
+
+    std::vector<int> xs = latticeAxis(width, tileSize);
+    std::vector<int> ys = latticeAxis(height, tileSize);
+    int latticeCols = (int)xs.size(), latticeRows = (int)ys.size();
+    int tilesX = latticeCols - 1, tilesY = latticeRows - 1;
+    int tileCount = tilesX * tilesY;
+
+    // Maps are one network call per pixel; small fixed shapes take the
+    // compile-time specialized path
+    StaticClassifier* fast = CreateStaticClassifier(model);
+
+    // Coarse lattice in one parallel batch
+    int latticeCount = latticeCols * latticeRows;
+    std::vector<float> latticeInput((size_t)latticeCount * 2);
+    std::vector<int> latticeLabels(latticeCount);
+    for (int j = 0; j < latticeRows; j++)
+        for (int i = 0; i < latticeCols; i++)
+        {
+            latticeInput[2 * (j * latticeCols + i)] = grid.originX + xs[i] * grid.stepX;
+            latticeInput[2 * (j * latticeCols + i) + 1] = grid.originY + ys[j] * grid.stepY;
+        }
+    if (fast != nullptr)
+        fast->ExecuteTestParallel(latticeInput.data(), latticeLabels.data(), latticeCount);
+    else
+        model.ExecuteTestParallel(latticeInput.data(), latticeLabels.data(), latticeCount);
+
+    // Bucket the probes by tile (counting sort)
+    std::vector<int> probeStart(tileCount + 1, 0);
+    std::vector<int> probeTile(probeCount > 0 ? probeCount : 0, -1);
+    for (int p = 0; p < probeCount; p++)
+    {
+        int x = probePixels[2 * p], y = probePixels[2 * p + 1];
+        if (x < 0 || x >= width || y < 0 || y >= height)
+            continue;
+        int tx = x / tileSize < tilesX ? x / tileSize : tilesX - 1;
+        int ty = y / tileSize < tilesY ? y / tileSize : tilesY - 1;
+        probeTile[p] = ty * tilesX + tx;
+        probeStart[probeTile[p] + 1]++;
+    }
+    for (int t = 0; t < tileCount; t++)
+        probeStart[t + 1] += probeStart[t];
+    std::vector<int> tileProbes((size_t)probeStart[tileCount] * 2);
+    std::vector<int> fill(probeStart.begin(), probeStart.end() - 1);
+    for (int p = 0; p < probeCount; p++)
+    {
+        if (probeTile[p] < 0)
+            continue;
+        int slot = fill[probeTile[p]]++;
+        tileProbes[2 * slot] = probePixels[2 * p];
+        tileProbes[2 * slot + 1] = probePixels[2 * p + 1];
+    }
+
+    ThreadPool& pool = DefaultThreadPool();
+    int workers = pool.ThreadCount();
+    int stride = tileSize + 1;
+    std::vector<int> blocks((size_t)workers * stride * stride);
+    std::vector<long long> evaluations(workers, 0);
+    InferenceWorkspace* workspaces = new InferenceWorkspace[workers];
+    for (int w = 0; w < workers; w++)
+        workspaces[w].Reserve(model);
+
+    pool.ParallelFor(tileCount, 1, [&](int begin, int end, int worker) {
+        TileRefiner refiner;
+        refiner.model = &model;
+        refiner.fast = fast;
+        refiner.grid = &grid;
+        refiner.workspace = &workspaces[worker];
+        refiner.block = blocks.data() + (size_t)worker * stride * stride;
+        refiner.stride = stride;
+        refiner.evaluations = 0;
+
+        for (int t = begin; t < end; t++)
+        {
+            int tx = t % tilesX, ty = t / tilesX;
+            int tileW = xs[tx + 1] - xs[tx], tileH = ys[ty + 1] - ys[ty];
+            refiner.originCol = xs[tx];
+            refiner.originRow = ys[ty];
+            refiner.probes = tileProbes.data() + 2 * (size_t)probeStart[t];
+            refiner.probeCount = probeStart[t + 1] - probeStart[t];
+
+            for (int k = 0; k < stride * stride; k++)
+                refiner.block[k] = -1;
+            refiner.at(0, 0) = latticeLabels[ty * latticeCols + tx];
+            refiner.at(tileW, 0) = latticeLabels[ty * latticeCols + tx + 1];
+            refiner.at(0, tileH) = latticeLabels[(ty + 1) * latticeCols + tx];
+            refiner.at(tileW, tileH) = latticeLabels[(ty + 1) * latticeCols + tx + 1];
+            refiner.refine(0, 0, tileW, tileH);
+
+            // A tile owns its right column and bottom row only at the map edge
+            int ownW = (tx == tilesX - 1) ? tileW + 1 : tileW;
+            int ownH = (ty == tilesY - 1) ? tileH + 1 : tileH;
+            for (int y = 0; y < ownH; y++)
+                for (int x = 0; x < ownW; x++)
+                    labels[(size_t)(refiner.originRow + y) * width + refiner.originCol + x] = refiner.at(x, y);
+        }
+        evaluations[worker] += refiner.evaluations;
+    });
+
+    delete[] workspaces;
+    delete fast;
+    long long total = latticeCount;
+    for (int w = 0; w < workers; w++)
+        total += evaluations[w];
+    return total;
+}
+
+bool ClassifyDecisionMapDense(const NeuralModel& model, const DecisionMapGrid& grid, int* labels)
+{
+    if (model.InputDimension() != 2)
+        return false;
+    int count = grid.width * grid.height;
+    std::vector<float> input((size_t)count * 2);
+    for (int row = 0; row < grid.height; row++)
+        for (int col = 0; col < grid.width; col++)
+        {
+            input[2 * ((size_t)row * grid.width + col)] = grid.originX + col * grid.stepX;
+            input[2 * ((size_t)row * grid.width + col) + 1] = grid.originY + row * grid.stepY;
+        }
+    // Same network path as ClassifyDecisionMap, so the two agree pixel for pixel
+    StaticClassifier* fast = CreateStaticClassifier(model);
+    if (fast != nullptr)
+        fast->ExecuteTestParallel(input.data(), labels, count);
+    else
+        model.ExecuteTestParallel(input.data(), labels, count);
+    delete fast;
+    return true;
+}
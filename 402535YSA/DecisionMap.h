@@ -0,0 +1,32 @@
+#pragma once
+
+class NeuralModel;
+
+// Edge length in pixels of the coarse tiles the map starts from
+#define DECISION_TILE_SIZE 16
+
+// Pixel (col, row) of a width x height map is classified at the 2-D input
+// (originX + col * stepX, originY + row * stepY)
+struct DecisionMapGrid
+{
+    int width;
+    int height;
+    float originX, originY;
+    float stepX, stepY;
+};
+
+// Fills labels[row * width + col] for every pixel of a 2-D model's map.
+// The network runs on a lattice of tileSize corners first; a tile whose
+// corners agree and that holds no probe pixel is filled with that class
+// without evaluating its interior, every other tile is split in four until
+// the pieces agree or are single pixels. Class regions smaller than a tile
+// that touch neither a corner nor a probe can be missed, so pass the
+// training samples' pixels (x, y pairs) as probes. Returns the number of
+// network evaluations, or -1 without touching labels if the model does not
+// take 2-D inputs.
+long long ClassifyDecisionMap(const NeuralModel& model, const DecisionMapGrid& grid, int* labels,
+    const int* probePixels = nullptr, int probeCount = 0, int tileSize = DECISION_TILE_SIZE);
+
+// Reference: classifies every pixel (width * height evaluations). False,
+// leaving labels untouched, if the model does not take 2-D inputs.
+bool ClassifyDecisionMapDense(const NeuralModel& model, const DecisionMapGrid& grid, int* labels);
@@ -0,0 +1,289 @@
+#include "pch.h"
+#include "EnsembleModel.h"
+#include "NeuralNetwork.h"
+#include "Kernels.h"
+#include "MatrixOps.h"
+#include "Process.h"
+#include "ThreadPool.h"
+#include <cfloat>
+#include <cstring>
+
+EnsembleModel::EnsembleModel()
+{
+    parameters = nullptr;
+    layerStart = nullptr;
+    unitCounts = nullptr;
+    weightOffset = nullptr;
+    firstColumn = nullptr;
+    modelCount = 0;
+    inputDimension = 0;
+    classCount = 0;
+    firstUnits = 0;
+    widestLayer = 0;
+    combine = ENSEMBLE_AVERAGE;
+}
+
+EnsembleModel::~EnsembleModel()
+{
+    release();
+}
+
+void EnsembleModel::release()
+{
+    free_aligned(parameters);
+    delete[] layerStart;
+    delete[] unitCounts;
+    delete[] weightOffset;
+    delete[] firstColumn;
+
+    parameters = nullptr;
+    layerStart = nullptr;
+    unitCounts = nullptr;
+    weightOffset = nullptr;
+    firstColumn = nullptr;
+    modelCount = 0;
+    inputDimension = 0;
+    classCount = 0;
+    firstUnits = 0;
+    widestLayer = 0;
+}
+
+bool EnsembleModel::Build(const NeuralModel* const* models, int modelCount, EnsembleCombine combine)
+{
+    release();
+    if (models == nullptr || modelCount < 1)
+        return false;
+    for (int k = 0; k < modelCount; k++)
+    {
+        if (models[k] == nullptr || models[k]->Parameters() == nullptr
+            || models[k]->InputDimension() != models[0]->InputDimension()
+            || models[k]->ClassCount() != models[0]->ClassCount())
+            return false;
+    }
+
+    this->modelCount = modelCount;
+    this->combine = combine;
+    inputDimension = models[0]->InputDimension();
+    classCount = models[0]->ClassCount();
+    layerStart = new int[modelCount + 1];
+    firstColumn = new int[modelCount + 1];
+
+    int entries = 0;
+    for (int k = 0; k < modelCount; k++)
+    {
+        layerStart[k] = entries;
+        firstColumn[k] = firstUnits;
+        entries += models[k]->LayerCount() - 1;
+        firstUnits += models[k]->UnitCount(0);
+    }
+    layerStart[modelCount] = entries;
+    firstColumn[modelCount] = firstUnits;
+    unitCounts = new int[entries > 0 ? entries : 1];
+    weightOffset = new size_t[entries > 0 ? entries : 1];
+
+    // Layout: the concatenated first layer, then the deeper layers member by member
+    size_t count = (size_t)inputDimension * firstUnits + firstUnits;
+    for (int k = 0; k < modelCount; k++)
+    {
+        for (int l = 1; l < models[k]->LayerCount(); l++)
+        {
+            int e = layerStart[k] + l - 1;
+            unitCounts[e] = models[k]->UnitCount(l);
+            weightOffset[e] = count;
+            count += (size_t)models[k]->FanIn(l) * unitCounts[e] + unitCounts[e];
+            widestLayer = (unitCounts[e] > widestLayer) ? unitCounts[e] : widestLayer;
+        }
+    }
+    parameters = alloc_aligned(count);
+
+    // Every layer is stored transposed (input major) for gemm_nn
+    float* firstOffsets = parameters + (size_t)inputDimension * firstUnits;
+    for (int k = 0; k < modelCount; k++)
+    {
+        const NeuralModel& model = *models[k];
+        for (int j = 0; j < model.UnitCount(0); j++)
+            for (int i = 0; i < inputDimension; i++)
+                parameters[(size_t)i * firstUnits + firstColumn[k] + j] = model.Weights(0)[(size_t)j * inputDimension + i];
+        memcpy(firstOffsets + firstColumn[k], model.Offsets(0), model.UnitCount(0) * sizeof(float));
+
+        for (int l = 1; l < model.LayerCount(); l++)
+        {
+            int e = layerStart[k] + l - 1;
+            int fanIn = model.FanIn(l);
+            float* w = parameters + weightOffset[e];
+            for (int j = 0; j < unitCounts[e]; j++)
+                for (int i = 0; i < fanIn; i++)
+                    w[(size_t)i * unitCounts[e] + j] = model.Weights(l)[(size_t)j * fanIn + i];
+            memcpy(w + (size_t)fanIn * unitCounts[e], model.Offsets(l), unitCounts[e] * sizeof(float));
+        }
+    }
+    return true;
+}
+
+// out = tanh(offsets + in * w) for rows x units, in being rows x fanIn with
+// row stride ld and w fanIn x units
+static void denseTanh(const float* in, int ld, int rows, int fanIn, const float* w, const float* offsets, int units, float* out)
+{
+    for (int r = 0; r < rows; r++)
+        memcpy(out + (size_t)r * units, offsets, units * sizeof(float));
+    gemm_nn(rows, units, fanIn, 1.0f, in, ld, w, units, 1.0f, out, units);
+    g_kernels.tanh(out, rows * units);
+}
+
+void EnsembleModel::predictTile(const float* input, int rows, int* predictedLabels, int* memberLabels, EnsembleWorkspace& ws) const
+{
+    // One pass over the tile's inputs feeds the first layer of every member
+    denseTanh(input, inputDimension, rows, inputDimension, parameters, parameters + (size_t)inputDimension * firstUnits,
+        firstUnits, ws.first);
+
+    memset(ws.scores, 0, (size_t)rows * classCount * sizeof(float));
+    memset(ws.votes, 0, (size_t)rows * classCount * sizeof(int));
+    for (int k = 0; k < modelCount; k++)
+    {
+        // A member's first-layer units are a column slice of ws.first
+        const float* in = ws.first + firstColumn[k];
+        int ld = firstUnits;
+        int fanIn = firstColumn[k + 1] - firstColumn[k];
+        float* buffers[2] = { ws.layers, ws.layers + (size_t)ENSEMBLE_TILE * widestLayer };
+        for (int e = layerStart[k]; e < layerStart[k + 1]; e++)
+        {
+            const float* w = parameters + weightOffset[e];
+            float* out = buffers[(e - layerStart[k]) & 1];
+            denseTanh(in, ld, rows, fanIn, w, w + (size_t)fanIn * unitCounts[e], unitCounts[e], out);
+            in = out;
+            ld = unitCounts[e];
+            fanIn = unitCounts[e];
+        }
+
+        for (int r = 0; r < rows; r++)
+        {
+            const float* output = in + (size_t)r * ld;
+            float* score = ws.scores + (size_t)r * classCount;
+            int maxIndex = 0;
+            float tempMax = -FLT_MAX;
+            for (int j = 0; j < classCount; j++)
+            {
+                score[j] += output[j];
+                if (output[j] > tempMax)
+                {
+                    tempMax = output[j];
+                    maxIndex = j;
+                }
+            }
+            ws.votes[(size_t)r * classCount + maxIndex]++;
+            if (memberLabels != nullptr)
+                memberLabels[(size_t)r * modelCount + k] = maxIndex;
+        }
+    }
+
+    for (int r = 0; r < rows; r++)
+    {
+        const float* score = ws.scores + (size_t)r * classCount;
+        const int* votes = ws.votes + (size_t)r * classCount;
+        int maxIndex = 0;
+        int maxVotes = -1;
+        float tempMax = -FLT_MAX;
+        for (int j = 0; j < classCount; j++)
+        {
+            bool better = (combine == ENSEMBLE_VOTE)
+                ? votes[j] > maxVotes || (votes[j] == maxVotes && score[j] > tempMax)
+                : score[j] > tempMax;
+            if (better)
+            {
+                maxVotes = votes[j];
+                tempMax = score[j];
+                maxIndex = j;
+            }
+        }
+        predictedLabels[r] = maxIndex;
+    }
+}
+
+void EnsembleModel::Predict(const float* testData, int* predictedLabels, int dataCount, EnsembleWorkspace& workspace,
+    int* memberLabels) const
+{
+    workspace.Reserve(*this);
+    for (int begin = 0; begin < dataCount; begin += ENSEMBLE_TILE)
+    {
+        int rows = (dataCount - begin < ENSEMBLE_TILE) ? dataCount - begin : ENSEMBLE_TILE;
+        predictTile(testData + (size_t)begin * inputDimension, rows, predictedLabels + begin,
+            (memberLabels != nullptr) ? memberLabels + (size_t)begin * modelCount : nullptr, workspace);
+    }
+}
+
+void EnsembleModel::ExecuteTest(const float* testData, int* predictedLabels, int dataCount, int* memberLabels) const
+{
+    EnsembleWorkspace workspace(*this);
+    Predict(testData, predictedLabels, dataCount, workspace, memberLabels);
+}
+
+void EnsembleModel::ExecuteTestParallel(const float* testData, int* predictedLabels, int dataCount, int* memberLabels) const
+{
+    ThreadPool& pool = DefaultThreadPool();
+    int workers = pool.ThreadCount();
+
+    EnsembleWorkspace* workspaces = new EnsembleWorkspace[workers];
+    pool.ParallelFor(dataCount, PARALLEL_GRAIN, [&](int begin, int end, int worker) {
+        Predict(testData + (size_t)begin * inputDimension, predictedLabels + begin, end - begin, workspaces[worker],
+            (memberLabels != nullptr) ? memberLabels + (size_t)begin * modelCount : nullptr);
+    });
+    delete[] workspaces;
+}
+
+EnsembleWorkspace::EnsembleWorkspace()
+{
+    first = nullptr;
+    firstSize = 0;
+    layers = nullptr;
+    layerSize = 0;
+    scores = nullptr;
+    votes = nullptr;
+    scoreSize = 0;
+}
+
+EnsembleWorkspace::EnsembleWorkspace(const EnsembleModel& model)
+{
+    first = nullptr;
+    firstSize = 0;
+    layers = nullptr;
+    layerSize = 0;
+    scores = nullptr;
+    votes = nullptr;
+    scoreSize = 0;
+    Reserve(model);
+}
+
+EnsembleWorkspace::~EnsembleWorkspace()
+{
+    delete[] first;
+    delete[] layers;
+    delete[] scores;
+    delete[] votes;
+}
+
+void EnsembleWorkspace::Reserve(const EnsembleModel& model)
+{
+    size_t need = (size_t)ENSEMBLE_TILE * model.firstUnits;
+    if (need > firstSize)
+    {
+        delete[] first;
+        first = new float[need];
+        firstSize = need;
+    }
+    need = (size_t)2 * ENSEMBLE_TILE * model.widestLayer;
+    if (need > layerSize)
+    {
+        delete[] layers;
+        layers = new float[need];
+        layerSize = need;
+    }
+    need = (size_t)ENSEMBLE_TILE * model.classCount;
+    if (need > scoreSize)
+    {
+        delete[] scores;
+        delete[] votes;
+        scores = new float[need];
+        votes = new int[need];
+        scoreSize = need;
+    }
+}
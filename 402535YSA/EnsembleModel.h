@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+
+class NeuralModel;
+class EnsembleModel;
+
+// Samples per tile of EnsembleModel::Predict
+#define ENSEMBLE_TILE 64
+
+// How the members' outputs become one label
+enum EnsembleCombine
+{
+    ENSEMBLE_AVERAGE = 0,   // argmax of the summed output activations
+    ENSEMBLE_VOTE           // most member argmaxes; ties go to the higher summed output
+};
+
+// Per-call scratch for EnsembleModel::Predict, one per thread like
+// InferenceWorkspace
+class EnsembleWorkspace
+{
+public:
+    EnsembleWorkspace();
+    explicit EnsembleWorkspace(const EnsembleModel& model);
+    ~EnsembleWorkspace();
+    // Grows the buffers to fit the ensemble's shape
+    void Reserve(const EnsembleModel& model);
+private:
+    friend class EnsembleModel;
+    float* first;           // first layer of every member, tile x FirstUnits()
+    size_t firstSize;
+    float* layers;          // two tile x widest-layer buffers, used in turn
+    size_t layerSize;
+    float* scores;          // summed outputs, tile x classes
+    int* votes;
+    size_t scoreSize;
+    EnsembleWorkspace(const EnsembleWorkspace&);
+    EnsembleWorkspace& operator=(const EnsembleWorkspace&);
+};
+
+// Several NeuralModels with the same inputs and classes scored together.
+// The members' first layers are concatenated into one wide layer, stored
+// input-major, so each tile of ENSEMBLE_TILE samples is read once and
+// every input is one multiply-add across all members' first-layer units.
+// The deeper layers of each member then run on the tile, and outputs are
+// combined as they come out, so the whole ensemble is a single pass.
+class EnsembleModel
+{
+public:
+    EnsembleModel();
+    ~EnsembleModel();
+    // Copies the (folded) parameters of modelCount models. Returns false,
+    // leaving the ensemble empty, for no models, an empty one, or members
+    // whose input dimension or class count differ.
+    bool Build(const NeuralModel* const* models, int modelCount, EnsembleCombine combine);
+    bool IsBuilt() const { return parameters != nullptr; }
+    void SetCombine(EnsembleCombine combine) { this->combine = combine; }
+    EnsembleCombine Combine() const { return combine; }
+
+    // memberLabels, if not null, also gets every member's own label:
+    // dataCount x ModelCount() values, row-major (A/B comparisons)
+    void Predict(const float* testData, int* predictedLabels, int dataCount, EnsembleWorkspace& workspace,
+        int* memberLabels = nullptr) const;
+    void ExecuteTest(const float* testData, int* predictedLabels, int dataCount, int* memberLabels = nullptr) const;
+    void ExecuteTestParallel(const float* testData, int* predictedLabels, int dataCount, int* memberLabels = nullptr) const;
+
+    int ModelCount() const { return modelCount; }
+    int InputDimension() const { return inputDimension; }
+    int ClassCount() const { return classCount; }
+    int FirstUnits() const { return firstUnits; }
+private:
+    friend class EnsembleWorkspace;
+    void release();
+    void predictTile(const float* input, int rows, int* predictedLabels, int* memberLabels, EnsembleWorkspace& ws) const;
+
+    // Arena: concatenated first layer (inputDimension x firstUnits, input
+    // major, then firstUnits offsets), then every deeper layer of every
+    // member (FanIn x units, input major, then the offsets)
+    float* parameters;
+    int* layerStart;        // member k's deeper layers are entries layerStart[k] .. layerStart[k + 1] - 1
+    int* unitCounts;        // per entry
+    size_t* weightOffset;   // per entry; its offsets follow the weights
+    int* firstColumn;       // member k's first-layer units are columns firstColumn[k] .. firstColumn[k + 1] - 1
+    int modelCount;
+    int inputDimension;
+    int classCount;
+    int firstUnits;         // first-layer units of all members
+    int widestLayer;        // units of the widest deeper layer
+    EnsembleCombine combine;
+    EnsembleModel(const EnsembleModel&);
+    EnsembleModel& operator=(const EnsembleModel&);
+};
@@ -4,6 +4,16 @@
 #include <fstream>
 #include <string>
 #include "NeuralNetwork.h"
+#include "Optimizer.h"
+#include "Dataset.h"
+#include "Normalization.h"
+#include "DecisionMap.h"
+#include "TrainingJob.h"
+#include <msclr/marshal_cppstd.h>
+
+#define WEIGHT_FILE_FILTER "Binary weights (*.bin)|*.bin|Text weights (*.txt)|*.txt"
+// Progress / snapshot polling of a running training job, in milliseconds
+#define TRAINING_POLL_MS 200
 
 namespace CppCLRWinformsProjekt {
 
@@ -35,8 +45,14 @@ namespace CppCLRWinformsProjekt {
             AREASIZE = HEIGHT * WIDTH;
             MINX = WIDTH / -2;
             MAXY = HEIGHT / 2;
-            testData = new float[AREASIZE * 2];				// x-y Coord              
             tag = new int[AREASIZE];					// Class tag
+            samples = new Dataset(inputDim);
+            sampleStats = new FeatureStats(inputDim);
+            normMean = new float[inputDim];
+            normVariance = new float[inputDim];
+            trainingTimer = gcnew System::Windows::Forms::Timer();
+            trainingTimer->Interval = TRAINING_POLL_MS;
+            trainingTimer->Tick += gcnew System::EventHandler(this, &Form1::trainingTimer_Tick);
         }
     protected:
         ~Form1()
@@ -45,26 +61,45 @@ namespace CppCLRWinformsProjekt {
             {
                 delete components;
             }
-            delete[] testData;
+            trainingTimer->Stop();
+            delete trainingJob;         // cancels and waits for a running job
+            delete preview;
             delete[] tag;
-            delete[] Samples;
-            delete[] targets;
+            delete samples;
+            delete sampleStats;
+            delete[] normMean;
+            delete[] normVariance;
+            delete optimizer;
         }
 
     private:
         /// <summary>
         /// User Defined Variables
-        int  numClass = 0, numSample = 0;
+        int  numClass = 0;
         const int inputDim = 2;
-        float* Samples, * targets;
+        Dataset* samples;
+        FeatureStats* sampleStats;      // updated as samples are added
+        // Warm start state: samples [0, trainedCount) were trained with this
+        // optimizer on inputs normalized by normMean / normVariance
+        float* normMean, * normVariance;
+        Optimizer* optimizer = nullptr;
+        int trainedCount = 0;
+        bool freshWeights = false;      // random weights of button1, meant for normalized points
+        int trainedBatchSize = 0;
         NeuralModel* model = new NeuralModel;
+        // Training runs in trainingJob; while it does, model belongs to the
+        // job and the map is drawn from preview, its latest snapshot
+        TrainingJob* trainingJob = new TrainingJob;
+        NeuralModel* preview = new NeuralModel;
+        int previewVersion = 0;
+        String^ statusText;             // label3 when the job started
+        System::Windows::Forms::Timer^ trainingTimer;
         System::ComponentModel::IContainer^ components;
 
         // picture box area
         int WIDTH, HEIGHT;
         int AREASIZE;
         int MINX, MAXY;
-        float* testData;		// x-y Coord              
         int* tag;					// Class tag
 
     private: System::Windows::Forms::MenuStrip^ menuStrip1;
@@ -252,7 +287,7 @@ namespace CppCLRWinformsProjekt {
                // TrainTypeBox
                // 
                this->TrainTypeBox->FormattingEnabled = true;
-               this->TrainTypeBox->Items->AddRange(gcnew cli::array< System::Object^  >(2) { L"SGD", L"SGDwMomentum" });
+               this->TrainTypeBox->Items->AddRange(gcnew cli::array< System::Object^  >(6) { L"SGD", L"SGDwMomentum", L"Nesterov", L"RMSProp", L"Adam", L"MiniBatch" });
                this->TrainTypeBox->Location = System::Drawing::Point(10, 19);
                this->TrainTypeBox->Name = L"TrainTypeBox";
                this->TrainTypeBox->Size = System::Drawing::Size(82, 21);
@@ -464,6 +499,12 @@ namespace CppCLRWinformsProjekt {
                pictureBox1->CreateGraphics()->DrawLine(pen, temp_x - 5, temp_y, temp_x + 5, temp_y);
                pictureBox1->CreateGraphics()->DrawLine(pen, temp_x, temp_y - 5, temp_x, temp_y + 5);
            }//draw_sample
+           bool trainingBusy() {
+               if (!trainingJob->IsRunning())
+                   return false;
+               MessageBox::Show("Training is still running");
+               return true;
+           }
 #pragma endregion
     private: System::Void pictureBox1_MouseClick(System::Object^ sender, System::Windows::Forms::MouseEventArgs^ e) {
         if (numClass == 0)
@@ -482,23 +523,13 @@ namespace CppCLRWinformsProjekt {
                 MessageBox::Show("The class label cannot be greater than the maximum number of classes.");
             else {
                 label = numLabel - 1; //Values start from 0
-                if (numSample == 0) {
-                    numSample = 1;
-                    Samples = new float[numSample * inputDim];
-                    targets = new float[numSample];
-                    for (int i = 0; i < inputDim; i++)
-                        Samples[i] = x[i];
-                    targets[0] = float(label);
-                }
-                else {
-                    numSample++;
-                    Samples = Add_Data(Samples, numSample, x, inputDim);
-                    targets = Add_Labels(targets, numSample, label);
-                }
+                samples->Add(x, label);
+                sampleStats->Add(x, 1);
 
                 draw_sample(temp_x, temp_y, label);
-                label3->Text = "Samples Count: " + System::Convert::ToString(numSample);
+                label3->Text = "Samples Count: " + System::Convert::ToString(samples->Count());
             }
+            delete[] x;
         }
     }
     private: System::Void pictureBox1_Paint(System::Object^ sender, System::Windows::Forms::PaintEventArgs^ e) {
@@ -510,6 +541,8 @@ namespace CppCLRWinformsProjekt {
         e->Graphics->DrawLine(pen, 0, center_height, pictureBox1->Width, center_height);
     }
     private: System::Void button1_Click(System::Object^ sender, System::EventArgs^ e) {
+        if (trainingBusy())
+            return;
 
         //Input convertion
         numClass = Convert::ToInt32(ClassCountBox->Text);
@@ -523,49 +556,129 @@ namespace CppCLRWinformsProjekt {
 
         // Ağı sinir yapısı oluşturma
         model->InitializeModel(LAYER_COUNT, NEURON_COUNT, inputDim, numClass); // Init yerine InitializeModel
+        trainedCount = 0;
+        freshWeights = true;
 
         button1->Text = " Network is Ready : ";
     }
     private: System::Void button2_Click(System::Object^ sender, System::EventArgs^ e) {
-        // Batch Normalization
-        float mean[2];
-        float variance[2];
-        float* normalizedSamples = Batch_Norm(Samples, numSample, inputDim, mean, variance);
-
-        // Training
-        int cycle = 0;
-        if (TrainTypeBox->Text == "SGD")
-            cycle = model->performSGDTraining(normalizedSamples, targets, numSample); // TrainSGD -> performSGDTraining
-        else if (TrainTypeBox->Text == "SGDwMomentum")
-            cycle = model->performSGDTrainingWithMomentum(normalizedSamples, targets, numSample); // TrainSGDwMoment -> performSGDTrainingWithMomentum
-        else
+        // Clicked again while training: stop; trainingTimer_Tick finishes up
+        if (trainingJob->IsRunning()) {
+            trainingJob->Cancel();
+            return;
+        }
+        std::string trainType = msclr::interop::marshal_as<std::string>(TrainTypeBox->Text);
+        OptimizerType optimizerType = OPTIMIZER_SGD;
+        int batchSize = 1;
+        if (trainType == "MiniBatch")
+            batchSize = BATCH_SIZE;
+        bool known = trainType == "MiniBatch" || OptimizerFromName(trainType.c_str(), &optimizerType);
+        if (!known) {
             MessageBox::Show("Wrong Train Type");
-
-        if (cycle == 0) {
+            return;
+        }
+        // Nothing to train on: the job would refuse to start
+        if (samples->Count() == 0) {
             MessageBox::Show("Egitim yapilamadi");
-            cycle = CYCLE_MAX;
+            return;
+        }
+
+        // Points were only added since the last run with the same settings:
+        // keep weights, optimizer state and normalization and train on the
+        // new points plus a replay of old ones
+        bool warmStart = trainedCount > 0 && samples->Count() > trainedCount
+            && optimizer != nullptr && optimizer->Type() == optimizerType && batchSize == trainedBatchSize;
+
+        // Batch Normalization: the model normalizes each batch itself and
+        // folds the statistics into its first layer, so it takes raw points.
+        // Trained or read weights already take raw points and keep their
+        // function; fresh ones start out in normalized space.
+        if (!warmStart) {
+            sampleStats->Export(normMean, normVariance);
+            if (freshWeights)
+                model->AttachInputNormalization(normMean, normVariance);
+            else
+                model->SetInputNormalization(normMean, normVariance);
+            freshWeights = false;
         }
-        label3->Text += "   Cycle:" + System::Convert::ToString(cycle);
+
+        // Training runs on a worker thread; the timer shows its progress and
+        // snapshots and calls finishTraining
+        if (warmStart) {
+            IncrementalConfig config;
+            config.batchSize = batchSize;
+            trainingJob->StartIncremental(*model, *optimizer, samples->Features(), samples->Labels(), samples->Count(),
+                trainedCount, config);
+        }
+        else {
+            delete optimizer;
+            optimizer = CreateOptimizer(optimizerType);
+            TrainingConfig config;
+            config.batchSize = batchSize;
+            trainingJob->Start(*model, *optimizer, samples->Features(), samples->Labels(), samples->Count(), config);
+            trainedBatchSize = batchSize;
+        }
+        trainedCount = samples->Count();
+        statusText = label3->Text;
+        button2->Text = L"Stop";
+        trainingTimer->Start();
+    }
+    private: System::Void trainingTimer_Tick(System::Object^ sender, System::EventArgs^ e) {
+        TrainingProgress progress = trainingJob->Progress();
+        if (progress.epoch >= 0)
+            label3->Text = statusText + "   Epoch:" + System::Convert::ToString(progress.epoch + 1)
+                + "  Error:" + System::Convert::ToString(progress.trainError);
+        if (!progress.running) {
+            trainingTimer->Stop();
+            button2->Text = L"Train";
+            finishTraining(trainingJob->Wait());
+            return;
+        }
+        // Decision map of the latest snapshot while training goes on
+        if (progress.snapshotVersion != previewVersion && trainingJob->Snapshots().CopyLatest(*preview)) {
+            previewVersion = progress.snapshotVersion;
+            drawDecisionMap(*preview);
+        }
+    }
+    private: void finishTraining(const TrainingResult& result) {
+        // Epochs run, counted the same for cold and warm starts; only
+        // reaching the target error counts as success
+        int cycle = result.lastEpoch + 1;
+        if (result.reason != STOP_TARGET_ERROR && result.reason != STOP_CANCELLED)
+            MessageBox::Show("Egitim yapilamadi");
+        label3->Text = statusText + "   Cycle:" + System::Convert::ToString(cycle);
 
         // Plotting chart
-        for (int c = 0; c < cycle; c++)
-            if (c % 10 == 0)
-                chart1->Series["Error"]->Points->AddXY((int)c, model->errorHistory[c]);
+        const TrainingHistory& history = model->errorHistory;
+        for (int i = 0; i < history.Count(); i++)
+            chart1->Series["Error"]->Points->AddXY(history.Epoch(i), (double)history.Value(i));
 
         chart1->Refresh();
 
-        // Area Normalization
-        int counter = 0;
-        for (int row = 0; row < HEIGHT; row++)				// Y-AXIS
-            for (int col = 0; col < WIDTH; col++)			// X-AXIS
-            {
-                testData[counter * 2] = ((col + MINX) - mean[0]) / sqrt(variance[0]);		// X COORD
-                testData[counter * 2 + 1] = ((MAXY - row) - mean[1]) / sqrt(variance[1]);   // Y COORD
-                counter++;
-            }
-
-        // Testing
-        model->ExecuteTest(testData, tag, AREASIZE); // Test -> ExecuteTest
+        drawDecisionMap(*model);
+    }
+    // Classifies every pixel with m and shows the regions
+    private: void drawDecisionMap(const NeuralModel& m) {
+        // Area: pixel (col, row) is the point (col + MINX, MAXY - row); sample
+        // pixels are probed so small regions survive
+        int* probes = new int[samples->Count() * 2];
+        for (int i = 0; i < samples->Count(); i++) {
+            probes[2 * i] = static_cast<int>(samples->Sample(i)[0] + (WIDTH / 2.0f));
+            probes[2 * i + 1] = static_cast<int>((HEIGHT / 2.0f) - samples->Sample(i)[1]);
+        }
+        DecisionMapGrid grid;
+        grid.width = WIDTH;
+        grid.height = HEIGHT;
+        grid.originX = (float)MINX;
+        grid.originY = (float)MAXY;
+        grid.stepX = 1.0f;
+        grid.stepY = -1.0f;
+
+        // Testing; a map only exists for models of 2-D points
+        long long evaluations = ClassifyDecisionMap(m, grid, tag, probes, samples->Count());
+        delete[] probes;
+        if (evaluations < 0)
+            return;
         //Show Area
         Bitmap^ surface = gcnew Bitmap(WIDTH, HEIGHT);
         pictureBox1->Image = surface;
@@ -587,103 +700,52 @@ namespace CppCLRWinformsProjekt {
                 }//switch
                 surface->SetPixel(col, row, color);
             }
-        delete[] normalizedSamples;
     }
 
     private: System::Void readDataToolStripMenuItem_Click(System::Object^ sender, System::EventArgs^ e) {
-        char** c = new char* [1];
-        c[0] = "../Data/Samples.txt";
-        std::ifstream file;
-        int num, w, h, Dim;
-        file.open(c[0]);
-        if (file.is_open()) {
-            file >> Dim >> w >> h >> num;
-            textBox1->Text += "Dimension: " + Convert::ToString(Dim) + " w: " + Convert::ToString(w) +
-                " h:" + Convert::ToString(h) + " numClass: " + Convert::ToString(num) + "\r\n";
-            int inputDim = Dim;
-            numClass = num;
-
-            numSample = 0;
-            float* x = new float[inputDim];
-
-            while (!file.eof()) {
-                if (numSample == 0) {
-                    numSample = 1;
-                    Samples = new float[numSample * inputDim];
-                    targets = new float[numSample];
-
-                    for (int i = 0; i < inputDim; i++) {
-                        if (!(file >> Samples[i])) {
-                            break;
-                        }
-                    }
-                    if (!(file >> targets[0])) {
-                        break;
-                    }
-                }
-                else {
-                    for (int i = 0; i < inputDim; i++) {
-                        if (!(file >> x[i])) {
-                            break;
-                        }
-                    }
-                    int label;
-                    if (!(file >> label)) {
-                        break;
-                    }
-
-                    numSample++;
-                    Samples = Add_Data(Samples, numSample, x, inputDim);
-                    targets = Add_Labels(targets, numSample, label);
-                }
+        DatasetFileInfo info;
+        if (LoadDataset("../Data/Samples.txt", samples, &info)) {
+            trainedCount = 0;
+            sampleStats->Reset(samples->Dimension());
+            sampleStats->Add(samples->Features(), samples->Count());
+            textBox1->Text += "Dimension: " + Convert::ToString(info.dimension) + " w: " + Convert::ToString(info.width) +
+                " h:" + Convert::ToString(info.height) + " numClass: " + Convert::ToString(info.classCount) + "\r\n";
+            numClass = info.classCount;
+
+            // Build the listing once instead of growing the text box per value
+            System::Text::StringBuilder^ listing = gcnew System::Text::StringBuilder();
+            for (int i = 0; i < samples->Count(); i++) {
+                const float* x = samples->Sample(i);
+                int drawX = static_cast<int>(x[0] + info.width);
+                int drawY = static_cast<int>(info.height - x[1]);
+                draw_sample(drawX, drawY, samples->Label(i));
+
+                for (int j = 0; j < samples->Dimension(); j++)
+                    listing->Append(Convert::ToString(x[j]) + " ");
+                listing->Append(Convert::ToString(samples->Label(i)) + "\r\n");
             }
+            textBox1->Text += listing->ToString();
 
-            delete[] x;
-            file.close();
-
-            for (int i = 0; i < numSample; i++) {
-                int drawX = static_cast<int>(Samples[i * inputDim] + w);
-                int drawY = static_cast<int>(h - Samples[i * inputDim + 1]);
-                draw_sample(drawX, drawY, static_cast<int>(targets[i]));
-
-                for (int j = 0; j < inputDim; j++)
-                    textBox1->Text += Convert::ToString(Samples[i * inputDim + j]) + " ";
-                textBox1->Text += Convert::ToString(targets[i]) + "\r\n";
-            }
-
-            label3->Text = "Samples Count: " + System::Convert::ToString(numSample);
+            label3->Text = "Samples Count: " + System::Convert::ToString(samples->Count());
             MessageBox::Show("Dosya basari ile okundu");
         }
         else {
             MessageBox::Show("Dosya acilamadi");
         }
-
-        delete[]c;
     }
     private: System::Void saveDataToolStripMenuItem_Click(System::Object^ sender, System::EventArgs^ e) {
-        if (numSample != 0) {
-            char** c = new char* [1];
-            c[0] = "../Data/Samples.txt";
-            std::ofstream ofs(c[0]);
-            if (!ofs.bad()) {
-                ofs << inputDim << " " << pictureBox1->Width / 2 << " " << pictureBox1->Height / 2 << " " << numClass << std::endl;
-                for (int i = 0; i < numSample; i++) {
-                    for (int d = 0; d < inputDim; d++)
-                        ofs << Samples[i * inputDim + d] << " ";
-                    ofs << targets[i] << std::endl;
-                }
-                ofs.close();
-            }
-            else MessageBox::Show("Samples icin dosya acilamadi");
-            delete[]c;
+        if (samples->Count() != 0) {
+            DatasetFileInfo info = { inputDim, pictureBox1->Width / 2, pictureBox1->Height / 2, numClass };
+            if (!SaveDataset("../Data/Samples.txt", *samples, info))
+                MessageBox::Show("Samples icin dosya acilamadi");
         }
         else MessageBox::Show("At least one sample should be given");
     }
     private: System::Void button3_Click(System::Object^ sender, System::EventArgs^ e) {
-        if (numSample != 0)
-            for (int i = 0; i < numSample; i++) {
+        if (samples->Count() != 0)
+            for (int i = 0; i < samples->Count(); i++) {
                 Pen^ pen;
-                switch ((int)targets[i]) {
+                switch (samples->Label(i)) {
                 case 0: pen = gcnew Pen(Color::Black, 3.0f); break;
                 case 1: pen = gcnew Pen(Color::Red, 3.0f); break;
                 case 2: pen = gcnew Pen(Color::Blue, 3.0f); break;
@@ -693,17 +755,58 @@ namespace CppCLRWinformsProjekt {
                 case 6: pen = gcnew Pen(Color::ForestGreen, 3.0f); break;
                 default: pen = gcnew Pen(Color::Black, 3.0f); break;
                 }
-                int temp_x = static_cast<int>(Samples[i * 2] + (pictureBox1->Width / 2.0f));
-                int temp_y = static_cast<int>((pictureBox1->Height / 2.0f) - Samples[i * 2 + 1]);
+                int temp_x = static_cast<int>(samples->Sample(i)[0] + (pictureBox1->Width / 2.0f));
+                int temp_y = static_cast<int>((pictureBox1->Height / 2.0f) - samples->Sample(i)[1]);
                 pictureBox1->CreateGraphics()->DrawLine(pen, temp_x - 5, temp_y, temp_x + 5, temp_y);
                 pictureBox1->CreateGraphics()->DrawLine(pen, temp_x, temp_y - 5, temp_x, temp_y + 5);
             }
     }
     private: System::Void readWeightsToolStripMenuItem_Click(System::Object^ sender, System::EventArgs^ e) {
-        model->InitializeFromWeightsFile(); // InitFromFile -> InitializeFromWeightsFile
+        if (trainingBusy())
+            return;
+        openFileDialog1->Filter = WEIGHT_FILE_FILTER;
+        openFileDialog1->InitialDirectory = Path::GetFullPath("../Data");
+        openFileDialog1->FileName = "";
+        if (openFileDialog1->ShowDialog() != System::Windows::Forms::DialogResult::OK)
+            return;
+        std::string path = msclr::interop::marshal_as<std::string>(openFileDialog1->FileName);
+
+        // Binary files are mapped in place, text files are parsed
+        bool loaded = Path::GetExtension(openFileDialog1->FileName)->ToLower() == ".txt"
+            ? model->ImportWeightsText(path.c_str())
+            : model->MapWeights(path.c_str());
+        if (!loaded) {
+            MessageBox::Show("Ağırlık dosyası açılamadı");
+            return;
+        }
+        trainedCount = 0;
+        freshWeights = false;
+
+        String^ StringArray;
+        for (int i = 0; i < model->LayerCount() - 1; i++)
+            StringArray += Convert::ToString(model->UnitCount(i)) + " ";
+        MessageBox::Show("Dosya başarı ile okundu" + "\r\n"
+            + "Dimension:  " + Convert::ToString(model->InputDimension()) + "\r\n"
+            + "Hidden Layer:  " + Convert::ToString(model->LayerCount() - 1) + "\r\n"
+            + "Neurons:  " + StringArray + "\r\n"
+            + "numClass:  " + Convert::ToString(model->ClassCount()) + "\r\n"
+        );
     }
     private: System::Void saveWeightsToolStripMenuItem_Click(System::Object^ sender, System::EventArgs^ e) {
-        model->ExportWeights(); // SaveWeights -> ExportWeights
+        if (trainingBusy())
+            return;
+        saveFileDialog1->Filter = WEIGHT_FILE_FILTER;
+        saveFileDialog1->InitialDirectory = Path::GetFullPath("../Data");
+        saveFileDialog1->FileName = "weights.bin";
+        if (saveFileDialog1->ShowDialog() != System::Windows::Forms::DialogResult::OK)
+            return;
+        std::string path = msclr::interop::marshal_as<std::string>(saveFileDialog1->FileName);
+
+        bool saved = Path::GetExtension(saveFileDialog1->FileName)->ToLower() == ".txt"
+            ? model->ExportWeightsText(path.c_str())
+            : model->SaveWeights(path.c_str());
+        if (!saved)
+            MessageBox::Show("Dosya açılamadı");
     }
 
     private: System::Void label1_Click(System::Object^ sender, System::EventArgs^ e) {
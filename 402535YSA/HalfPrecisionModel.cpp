@@ -0,0 +1,262 @@
+#include "pch.h"
+#include "HalfPrecisionModel.h"
+#include "NeuralNetwork.h"
+#include "Kernels.h"
+#include "Process.h"
+#include "ThreadPool.h"
+#include <cfloat>
+#include <cstring>
+
+// Values converted per RoundToPrecision chunk (on the stack)
+#define ROUND_CHUNK 256
+
+static size_t roundUpBlock(size_t n)
+{
+    return (n + KERNEL_HALF_BLOCK - 1) / KERNEL_HALF_BLOCK * KERNEL_HALF_BLOCK;
+}
+
+void RoundToPrecision(const float* in, float* out, size_t n, WeightPrecision precision)
+{
+    if (precision == PRECISION_FP32)
+    {
+        if (in != out)
+            memcpy(out, in, n * sizeof(float));
+        return;
+    }
+    bool bf16 = precision == PRECISION_BF16;
+    unsigned short packed[ROUND_CHUNK];
+    for (size_t i = 0; i < n; i += ROUND_CHUNK)
+    {
+        int count = (n - i < ROUND_CHUNK) ? (int)(n - i) : ROUND_CHUNK;
+        if (bf16)
+        {
+            g_kernels.packBf16(in + i, packed, count);
+            g_kernels.unpackBf16(packed, out + i, count);
+        }
+        else
+        {
+            g_kernels.packF16(in + i, packed, count);
+            g_kernels.unpackF16(packed, out + i, count);
+        }
+    }
+}
+
+HalfPrecisionModel::HalfPrecisionModel()
+{
+    weights = nullptr;
+    weightOffset = nullptr;
+    rowStride = nullptr;
+    inputOffset = nullptr;
+    inputTotal = 0;
+    offsets = nullptr;
+    unitOffset = nullptr;
+    unitCounts = nullptr;
+    layerTotal = 0;
+    inputDimension = 0;
+    precision = PRECISION_FP32;
+}
+
+HalfPrecisionModel::~HalfPrecisionModel()
+{
+    release();
+}
+
+void HalfPrecisionModel::release()
+{
+    free_aligned(reinterpret_cast<float*>(weights));
+    delete[] weightOffset;
+    delete[] rowStride;
+    delete[] inputOffset;
+    delete[] offsets;
+    delete[] unitOffset;
+    delete[] unitCounts;
+
+    weights = nullptr;
+    weightOffset = nullptr;
+    rowStride = nullptr;
+    inputOffset = nullptr;
+    inputTotal = 0;
+    offsets = nullptr;
+    unitOffset = nullptr;
+    unitCounts = nullptr;
+    layerTotal = 0;
+    inputDimension = 0;
+    precision = PRECISION_FP32;
+}
+
+bool HalfPrecisionModel::Convert(const NeuralModel& model, WeightPrecision precision)
+{
+    if (model.Parameters() == nullptr || precision == PRECISION_FP32)
+        return false;
+    release();
+
+    this->precision = precision;
+    layerTotal = model.LayerCount();
+    inputDimension = model.InputDimension();
+    unitCounts = new int[layerTotal];
+    unitOffset = new int[layerTotal];
+    rowStride = new int[layerTotal];
+    weightOffset = new size_t[layerTotal];
+    inputOffset = new size_t[layerTotal];
+
+    // Layout: every weight row and every layer input padded to whole blocks
+    int units = 0;
+    size_t weightCount = 0;
+    for (int l = 0; l < layerTotal; l++)
+    {
+        unitCounts[l] = model.UnitCount(l);
+        unitOffset[l] = units;
+        units += unitCounts[l];
+
+        rowStride[l] = (int)roundUpBlock(model.FanIn(l));
+        weightOffset[l] = weightCount;
+        weightCount += (size_t)rowStride[l] * unitCounts[l];
+        inputOffset[l] = inputTotal;
+        inputTotal += rowStride[l];
+    }
+    offsets = new float[units];
+
+    weights = reinterpret_cast<unsigned short*>(alloc_aligned((weightCount + 1) / 2));
+    memset(weights, 0, weightCount * sizeof(unsigned short));
+    for (int l = 0; l < layerTotal; l++)
+    {
+        int fanIn = model.FanIn(l);
+        for (int j = 0; j < unitCounts[l]; j++)
+        {
+            const float* w = model.Weights(l) + (size_t)j * fanIn;
+            unsigned short* row = weights + weightOffset[l] + (size_t)j * rowStride[l];
+            if (precision == PRECISION_BF16)
+                g_kernels.packBf16(w, row, fanIn);
+            else
+                g_kernels.packF16(w, row, fanIn);
+        }
+        memcpy(offsets + unitOffset[l], model.Offsets(l), unitCounts[l] * sizeof(float));
+    }
+    return true;
+}
+
+int HalfPrecisionModel::classifySample(const float* input, HalfPrecisionWorkspace& ws) const
+{
+    memcpy(ws.inputs + inputOffset[0], input, inputDimension * sizeof(float));
+
+    void (*gemv)(const unsigned short*, int, int, const float*, float*) =
+        (precision == PRECISION_BF16) ? g_kernels.gemvBf16 : g_kernels.gemvF16;
+    float* sums = ws.sums;
+    for (int l = 0; l < layerTotal; l++)
+    {
+        // Hidden layers write straight into the next layer's input row
+        float* out = (l == layerTotal - 1) ? sums : ws.inputs + inputOffset[l + 1];
+        const float* offset = offsets + unitOffset[l];
+        gemv(weights + weightOffset[l], unitCounts[l], rowStride[l], ws.inputs + inputOffset[l], out);
+        for (int j = 0; j < unitCounts[l]; j++)
+            out[j] += offset[j];
+        // tanh is monotonic, so the output layer's argmax skips it
+        if (l < layerTotal - 1)
+            g_kernels.tanh(out, unitCounts[l]);
+    }
+
+    int maxIndex = 0;
+    float tempMax = -FLT_MAX;
+    for (int j = 0; j < ClassCount(); j++)
+    {
+        if (sums[j] > tempMax)
+        {
+            tempMax = sums[j];
+            maxIndex = j;
+        }
+    }
+    return maxIndex;
+}
+
+void HalfPrecisionModel::Predict(const float* testData, int* predictedLabels, int dataCount, HalfPrecisionWorkspace& workspace) const
+{
+    workspace.Reserve(*this);
+    for (int sample = 0; sample < dataCount; sample++)
+        predictedLabels[sample] = classifySample(testData + (size_t)sample * inputDimension, workspace);
+}
+
+void HalfPrecisionModel::ExecuteTest(const float* testData, int* predictedLabels, int dataCount) const
+{
+    HalfPrecisionWorkspace workspace(*this);
+    Predict(testData, predictedLabels, dataCount, workspace);
+}
+
+void HalfPrecisionModel::ExecuteTestParallel(const float* testData, int* predictedLabels, int dataCount) const
+{
+    ThreadPool& pool = DefaultThreadPool();
+    int workers = pool.ThreadCount();
+
+    HalfPrecisionWorkspace* workspaces = new HalfPrecisionWorkspace[workers];
+    pool.ParallelFor(dataCount, PARALLEL_GRAIN, [&](int begin, int end, int worker) {
+        Predict(testData + (size_t)begin * inputDimension, predictedLabels + begin, end - begin, workspaces[worker]);
+    });
+    delete[] workspaces;
+}
+
+QuantizationReport HalfPrecisionModel::Compare(const NeuralModel& model, const float* testData, const int* labels, int dataCount) const
+{
+    int* floatLabels = new int[dataCount];
+    int* halfLabels = new int[dataCount];
+    model.ExecuteTestParallel(testData, floatLabels, dataCount);
+    ExecuteTestParallel(testData, halfLabels, dataCount);
+
+    QuantizationReport report;
+    report.sampleCount = dataCount;
+    report.agreement = 0;
+    report.floatCorrect = (labels != nullptr) ? 0 : -1;
+    report.quantizedCorrect = (labels != nullptr) ? 0 : -1;
+    for (int i = 0; i < dataCount; i++)
+    {
+        if (floatLabels[i] == halfLabels[i])
+            report.agreement++;
+        if (labels != nullptr)
+        {
+            report.floatCorrect += (floatLabels[i] == labels[i]);
+            report.quantizedCorrect += (halfLabels[i] == labels[i]);
+        }
+    }
+    delete[] floatLabels;
+    delete[] halfLabels;
+    return report;
+}
+
+HalfPrecisionWorkspace::HalfPrecisionWorkspace()
+{
+    inputs = nullptr;
+    inputSize = 0;
+    sums = nullptr;
+    sumSize = 0;
+}
+
+HalfPrecisionWorkspace::HalfPrecisionWorkspace(const HalfPrecisionModel& model)
+{
+    inputs = nullptr;
+    inputSize = 0;
+    sums = nullptr;
+    sumSize = 0;
+    Reserve(model);
+}
+
+HalfPrecisionWorkspace::~HalfPrecisionWorkspace()
+{
+    delete[] inputs;
+    delete[] sums;
+}
+
+void HalfPrecisionWorkspace::Reserve(const HalfPrecisionModel& model)
+{
+    if (model.inputTotal > inputSize)
+    {
+        delete[] inputs;
+        inputs = new float[model.inputTotal];
+        inputSize = model.inputTotal;
+    }
+    if (model.ClassCount() > sumSize)
+    {
+        delete[] sums;
+        sums = new float[model.ClassCount()];
+        sumSize = model.ClassCount();
+    }
+    // Layers only write their first FanIn values; the padding must read as zero
+    memset(inputs, 0, inputSize * sizeof(float));
+}
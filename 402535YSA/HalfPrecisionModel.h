@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include "TrainingConfig.h"
+#include "QuantizedModel.h"
+
+class NeuralModel;
+class HalfPrecisionModel;
+
+// Per-call scratch for HalfPrecisionModel::Predict, one per thread like
+// InferenceWorkspace
+class HalfPrecisionWorkspace
+{
+public:
+    HalfPrecisionWorkspace();
+    explicit HalfPrecisionWorkspace(const HalfPrecisionModel& model);
+    ~HalfPrecisionWorkspace();
+    // Grows the buffers to fit the model's shape and clears the padding
+    void Reserve(const HalfPrecisionModel& model);
+private:
+    friend class HalfPrecisionModel;
+    float* inputs;          // fp32 input row of every layer, padded
+    size_t inputSize;
+    float* sums;            // pre-activations of the output layer
+    int sumSize;
+    HalfPrecisionWorkspace(const HalfPrecisionWorkspace&);
+    HalfPrecisionWorkspace& operator=(const HalfPrecisionWorkspace&);
+};
+
+// bf16 or fp16 copy of a NeuralModel for batch prediction. Weights take
+// half the memory and bandwidth of fp32; g_kernels.gemvF16 / gemvBf16 widen
+// them to fp32 as they are loaded and accumulate in fp32. Offsets,
+// activations and the argmax stay fp32, and unlike QuantizedModel no
+// calibration data is needed.
+class HalfPrecisionModel
+{
+public:
+    HalfPrecisionModel();
+    ~HalfPrecisionModel();
+    // Rounds the weights of model to precision (to nearest even; fp16
+    // overflows to infinity). Returns false for an empty model or
+    // PRECISION_FP32.
+    bool Convert(const NeuralModel& model, WeightPrecision precision);
+    bool IsConverted() const { return weights != nullptr; }
+    WeightPrecision Precision() const { return precision; }
+
+    void Predict(const float* testData, int* predictedLabels, int dataCount, HalfPrecisionWorkspace& workspace) const;
+    void ExecuteTest(const float* testData, int* predictedLabels, int dataCount) const;
+    void ExecuteTestParallel(const float* testData, int* predictedLabels, int dataCount) const;
+
+    // Runs model.ExecuteTestParallel and this model on the same samples;
+    // labels may be null
+    QuantizationReport Compare(const NeuralModel& model, const float* testData, const int* labels, int dataCount) const;
+
+    int LayerCount() const { return layerTotal; }
+    int UnitCount(int layer) const { return unitCounts[layer]; }
+    int InputDimension() const { return inputDimension; }
+    int ClassCount() const { return unitCounts[layerTotal - 1]; }
+private:
+    friend class HalfPrecisionWorkspace;
+    void release();
+    int classifySample(const float* input, HalfPrecisionWorkspace& ws) const;
+
+    unsigned short* weights;    // row-major 16-bit rows of rowStride[l] values, zero padded
+    size_t* weightOffset;       // start of layer l in weights
+    int* rowStride;             // FanIn(l) rounded up to KERNEL_HALF_BLOCK
+    size_t* inputOffset;        // start of layer l's input row in a workspace
+    size_t inputTotal;
+    float* offsets;             // per unit, fp32
+    int* unitOffset;            // units in the layers before l
+    int* unitCounts;
+    int layerTotal;
+    int inputDimension;
+    WeightPrecision precision;
+    HalfPrecisionModel(const HalfPrecisionModel&);
+    HalfPrecisionModel& operator=(const HalfPrecisionModel&);
+};
+
+// out[i] = in[i] rounded to precision and widened back to fp32 (a copy for
+// PRECISION_FP32); in and out may be the same array
+void RoundToPrecision(const float* in, float* out, size_t n, WeightPrecision precision);
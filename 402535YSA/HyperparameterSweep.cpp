@@ -0,0 +1,353 @@
+#include "pch.h"
+#include "HyperparameterSweep.h"
+#include "NeuralNetwork.h"
+#include "Normalization.h"
+#include "ThreadPool.h"
+#include "TrainingJob.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstdlib>
+#include <math.h>
+#include <vector>
+
+// Units of the single hidden layer when no shape is listed
+#define SWEEP_DEFAULT_UNITS 8
+
+// xorshift like the validation split of Train, so a sweep does not consume
+// rand() beyond the weight initialization
+static unsigned int nextSweepState(unsigned int* state)
+{
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+SweepSpace::SweepSpace()
+{
+    shapeCount = 0;
+    optimizerCount = 0;
+    rateCount = 0;
+    batchCount = 0;
+}
+
+bool SweepSpace::AddShape(int layerCount, const int* units)
+{
+    if (shapeCount == SWEEP_MAX_CHOICES || layerCount < 1 || layerCount > SWEEP_MAX_LAYERS)
+        return false;
+    for (int l = 0; l < layerCount; l++)
+        if (units[l] < 1)
+            return false;
+    layerCounts[shapeCount] = layerCount;
+    for (int l = 0; l < layerCount; l++)
+        this->units[shapeCount][l] = units[l];
+    shapeCount++;
+    return true;
+}
+
+bool SweepSpace::AddOptimizer(OptimizerType optimizer)
+{
+    if (optimizerCount == SWEEP_MAX_CHOICES)
+        return false;
+    optimizers[optimizerCount++] = optimizer;
+    return true;
+}
+
+bool SweepSpace::AddLearningRate(float learningRate)
+{
+    if (rateCount == SWEEP_MAX_CHOICES || !(learningRate > 0))
+        return false;
+    rates[rateCount++] = learningRate;
+    return true;
+}
+
+bool SweepSpace::AddBatchSize(int batchSize)
+{
+    if (batchCount == SWEEP_MAX_CHOICES || batchSize < 1)
+        return false;
+    batchSizes[batchCount++] = batchSize;
+    return true;
+}
+
+static int atLeastOne(int count)
+{
+    return (count > 0) ? count : 1;
+}
+
+int SweepSpace::GridSize() const
+{
+    return atLeastOne(shapeCount) * atLeastOne(optimizerCount) * atLeastOne(rateCount) * atLeastOne(batchCount);
+}
+
+void SweepSpace::fillShape(int shape, SweepTrial* trial) const
+{
+    if (shapeCount == 0)
+    {
+        trial->layerCount = 1;
+        trial->units[0] = SWEEP_DEFAULT_UNITS;
+        return;
+    }
+    trial->layerCount = layerCounts[shape];
+    for (int l = 0; l < layerCounts[shape]; l++)
+        trial->units[l] = units[shape][l];
+}
+
+// Index order: batch size fastest, then rate, optimizer and shape
+SweepTrial SweepSpace::GridTrial(int index) const
+{
+    SweepTrial trial;
+    int batch = index % atLeastOne(batchCount);
+    index /= atLeastOne(batchCount);
+    int rate = index % atLeastOne(rateCount);
+    index /= atLeastOne(rateCount);
+    int optimizer = index % atLeastOne(optimizerCount);
+    index /= atLeastOne(optimizerCount);
+    fillShape(index % atLeastOne(shapeCount), &trial);
+    trial.optimizer = (optimizerCount > 0) ? optimizers[optimizer] : OPTIMIZER_SGD;
+    trial.learningRate = (rateCount > 0) ? rates[rate] : 0;
+    trial.batchSize = (batchCount > 0) ? batchSizes[batch] : 1;
+    return trial;
+}
+
+SweepTrial SweepSpace::RandomTrial(unsigned int* state) const
+{
+    SweepTrial trial;
+    fillShape((int)(nextSweepState(state) % (unsigned int)atLeastOne(shapeCount)), &trial);
+    trial.optimizer = (optimizerCount > 0) ? optimizers[nextSweepState(state) % (unsigned int)optimizerCount] : OPTIMIZER_SGD;
+    trial.batchSize = (batchCount > 0) ? batchSizes[nextSweepState(state) % (unsigned int)batchCount] : 1;
+
+    trial.learningRate = 0;
+    if (rateCount > 0)
+    {
+        float low = rates[0], high = rates[0];
+        for (int i = 1; i < rateCount; i++)
+        {
+            low = (rates[i] < low) ? rates[i] : low;
+            high = (rates[i] > high) ? rates[i] : high;
+        }
+        double u = (nextSweepState(state) >> 8) / 16777216.0;
+        trial.learningRate = (float)(low * exp(u * log((double)high / low)));
+    }
+    return trial;
+}
+
+SweepConfig::SweepConfig()
+{
+    randomTrials = 0;
+    seed = 1;
+    validationFraction = (float)SWEEP_VALIDATION;
+    minEpochs = SWEEP_MIN_EPOCHS;
+    maxEpochs = SWEEP_MAX_EPOCHS;
+    eta = SWEEP_ETA;
+    pool = nullptr;
+}
+
+HyperparameterSweep::HyperparameterSweep()
+{
+    trialCount = 0;
+    results = nullptr;
+    models = nullptr;
+    optimizers = nullptr;
+    ranking = nullptr;
+}
+
+HyperparameterSweep::~HyperparameterSweep()
+{
+    release();
+}
+
+void HyperparameterSweep::release()
+{
+    for (int i = 0; i < trialCount; i++)
+        delete optimizers[i];
+    delete[] results;
+    delete[] models;
+    delete[] optimizers;
+    delete[] ranking;
+
+    trialCount = 0;
+    results = nullptr;
+    models = nullptr;
+    optimizers = nullptr;
+    ranking = nullptr;
+}
+
+const NeuralModel& HyperparameterSweep::Model(int rank) const
+{
+    return models[ranking[rank]];
+}
+
+bool HyperparameterSweep::Run(const SweepSpace& space, const float* trainingData, const int* targetLabels, int sampleCount,
+    int dimension, int classCount, const SweepConfig& config)
+{
+    release();
+    int trials = (config.randomTrials > 0) ? config.randomTrials : space.GridSize();
+    if (sampleCount < 1 || dimension < 1 || classCount < 1 || trials < 1)
+        return false;
+    ThreadPool& pool = (config.pool != nullptr) ? *config.pool : DefaultThreadPool();
+    unsigned int state = config.seed ? config.seed : 1;
+
+    // The one shared copy: shuffled, training rows first, normalized with
+    // the statistics of the training rows
+    int validationCount = 0;
+    if (config.validationFraction > 0 && sampleCount > 1)
+    {
+        validationCount = (int)(config.validationFraction * sampleCount);
+        validationCount = (validationCount < 1) ? 1 : validationCount;
+        validationCount = (validationCount > sampleCount - 1) ? sampleCount - 1 : validationCount;
+    }
+    int trainCount = sampleCount - validationCount;
+
+    std::vector<int> order(sampleCount);
+    for (int i = 0; i < sampleCount; i++)
+        order[i] = i;
+    for (int i = sampleCount - 1; i > 0; i--)
+        std::swap(order[i], order[nextSweepState(&state) % (unsigned int)(i + 1)]);
+    std::vector<float> shared((size_t)sampleCount * dimension);
+    std::vector<int> sharedLabels(sampleCount);
+    for (int i = 0; i < sampleCount; i++)
+    {
+        std::copy(trainingData + (size_t)order[i] * dimension, trainingData + (size_t)(order[i] + 1) * dimension,
+            shared.begin() + (size_t)i * dimension);
+        sharedLabels[i] = targetLabels[order[i]];
+    }
+
+    FeatureStats stats(dimension);
+    stats.Add(shared.data(), trainCount, &pool);
+    std::vector<float> mean(dimension), variance(dimension), invStd(dimension);
+    stats.Export(mean.data(), variance.data());
+    InverseStdDev(variance.data(), invStd.data(), dimension);
+    NormalizeFeatures(shared.data(), shared.data(), sampleCount, dimension, mean.data(), invStd.data(), &pool);
+
+    // Trials, initialized one after the other so rand() gives the same
+    // weights for a seed
+    trialCount = trials;
+    results = new SweepResult[trials];
+    models = new NeuralModel[trials];
+    optimizers = new Optimizer*[trials];
+    ranking = new int[trials];
+    srand(config.seed);
+    for (int t = 0; t < trials; t++)
+    {
+        SweepResult& result = results[t];
+        result.trial = (config.randomTrials > 0) ? space.RandomTrial(&state) : space.GridTrial(t);
+        result.validationError = FLT_MAX;
+        result.trainError = FLT_MAX;
+        result.epochs = 0;
+        result.seconds = 0;
+        result.rung = 0;
+        result.pruned = false;
+        result.reason = STOP_MAX_EPOCHS;
+        models[t].InitializeModel(result.trial.layerCount, result.trial.units, dimension, classCount);
+        optimizers[t] = CreateOptimizer(result.trial.optimizer);
+        if (result.trial.learningRate > 0)
+            optimizers[t]->learningRate = result.trial.learningRate;
+        result.trial.learningRate = optimizers[t]->learningRate;
+        ranking[t] = t;
+    }
+
+    TrainingConfig base = config.training;
+    base.parallelism = TRAIN_SERIAL;    // the trials are the parallel work
+    base.pool = nullptr;
+    base.validationFraction = 0;
+    base.validationData = (validationCount > 0) ? shared.data() + (size_t)trainCount * dimension : nullptr;
+    base.validationLabels = (validationCount > 0) ? sharedLabels.data() + trainCount : nullptr;
+    base.validationCount = validationCount;
+    base.resetOptimizer = false;        // later rungs continue where the last stopped
+    base.telemetry = nullptr;           // one receiver cannot take concurrent reports
+    base.snapshots = nullptr;
+
+    // Best parameters of every trial over all its rungs. Each rung is a new
+    // Train call that only knows its own best epoch, so a later rung that
+    // ends worse must not cost a trial the weights it was ranked on.
+    std::vector<NeuralModel> best(trials);
+
+    // Successive halving over the trials still alive
+    std::vector<int> alive(ranking, ranking + trials);
+    int minEpochs = (config.minEpochs > 0) ? config.minEpochs : 1;
+    int maxEpochs = (config.maxEpochs > minEpochs) ? config.maxEpochs : minEpochs;
+    int eta = (config.eta > 1) ? config.eta : 2;
+    // With nothing to compare, a single trial trains its whole budget at once
+    int budget = (trials > 1) ? minEpochs : maxEpochs;
+    auto better = [&](int a, int b) {
+        if (results[a].validationError != results[b].validationError)
+            return results[a].validationError < results[b].validationError;
+        return results[a].seconds < results[b].seconds;
+    };
+    for (int rung = 0;; rung++)
+    {
+        // Trials that stopped on their own (target reached, patience, time)
+        // keep their result; the largest models start first so none of
+        // them is left running alone at the end
+        std::vector<int> work;
+        for (size_t k = 0; k < alive.size(); k++)
+        {
+            const SweepResult& result = results[alive[k]];
+            if (result.reason == STOP_MAX_EPOCHS && result.epochs < budget)
+                work.push_back(alive[k]);
+        }
+        std::stable_sort(work.begin(), work.end(), [&](int a, int b) {
+            return models[a].ParameterCount() * (size_t)(budget - results[a].epochs)
+                > models[b].ParameterCount() * (size_t)(budget - results[b].epochs);
+        });
+
+        pool.ParallelFor((int)work.size(), 1, [&](int begin, int end, int) {
+            for (int k = begin; k < end; k++)
+            {
+                int t = work[k];
+                SweepResult& result = results[t];
+                TrainingConfig trialConfig = base;
+                trialConfig.batchSize = result.trial.batchSize;
+                trialConfig.maxEpochs = budget - result.epochs;
+
+                double start = MonotonicSeconds();
+                TrainingResult trained = models[t].Train(shared.data(), sharedLabels.data(), trainCount, *optimizers[t],
+                    trialConfig);
+                result.seconds += MonotonicSeconds() - start;
+                result.epochs += trained.lastEpoch + 1;
+                result.trainError = trained.trainError;
+                result.reason = trained.reason;
+                result.rung = rung;
+
+                // The optimizer state belongs to the last epoch's weights;
+                // it is cleared whenever the trial goes on from other ones
+                // (Train's best epoch, or an earlier rung's best)
+                bool restored = base.restoreBest && trained.bestEpoch != trained.lastEpoch;
+                if (trained.bestError < result.validationError)
+                {
+                    result.validationError = trained.bestError;
+                    if (!best[t].CopyParametersFrom(models[t]))
+                        best[t] = models[t];
+                }
+                else
+                {
+                    models[t].CopyParametersFrom(best[t]);
+                    restored = true;
+                }
+                if (restored)
+                    optimizers[t]->Reset();
+            }
+        });
+
+        bool cancelled = base.cancel != nullptr && base.cancel->IsCancelled();
+        if (cancelled || budget >= maxEpochs)
+            break;
+        // The survivors always go on to the next rung, up to maxEpochs; a
+        // lone survivor has no one left to beat and skips straight there
+        std::stable_sort(alive.begin(), alive.end(), better);
+        size_t keep = (alive.size() + eta - 1) / eta;
+        for (size_t k = keep; k < alive.size(); k++)
+            results[alive[k]].pruned = true;
+        alive.resize(keep);
+        budget = (keep <= 1 || budget > maxEpochs / eta) ? maxEpochs : budget * eta;
+    }
+
+    // The models were trained on the normalized copy; from here on every
+    // one takes raw features
+    for (int t = 0; t < trials; t++)
+        models[t].AttachInputNormalization(mean.data(), variance.data());
+    std::stable_sort(ranking, ranking + trials, better);
+    return true;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include "TrainingConfig.h"
+#include "Optimizer.h"
+
+class NeuralModel;
+class ThreadPool;
+
+// Hidden layers of one swept shape, and choices per dimension of a space
+#define SWEEP_MAX_LAYERS 8
+#define SWEEP_MAX_CHOICES 32
+// Defaults of SweepConfig
+#define SWEEP_VALIDATION 0.2
+#define SWEEP_MIN_EPOCHS 100
+#define SWEEP_MAX_EPOCHS 2700
+#define SWEEP_ETA 3
+
+// One configuration of a sweep
+struct SweepTrial
+{
+    int layerCount;                     // hidden layers
+    int units[SWEEP_MAX_LAYERS];
+    OptimizerType optimizer;
+    float learningRate;                 // 0 keeps the optimizer's default
+    int batchSize;
+};
+
+// Choices for every hyperparameter. A grid sweep trains every combination;
+// a random one draws each dimension independently, with the learning rate
+// log-uniform between the smallest and largest listed rate.
+class SweepSpace
+{
+public:
+    SweepSpace();
+    // Each returns false once SWEEP_MAX_CHOICES are listed (or for a shape
+    // of more than SWEEP_MAX_LAYERS layers or with an empty layer)
+    bool AddShape(int layerCount, const int* units);
+    bool AddOptimizer(OptimizerType optimizer);
+    bool AddLearningRate(float learningRate);
+    bool AddBatchSize(int batchSize);
+
+    // Combinations of the listed values; a dimension with nothing listed
+    // counts once with its default (8 units, SGD, default rate, batch 1)
+    int GridSize() const;
+    SweepTrial GridTrial(int index) const;
+    SweepTrial RandomTrial(unsigned int* state) const;
+private:
+    int shapeCount, optimizerCount, rateCount, batchCount;
+    int layerCounts[SWEEP_MAX_CHOICES];
+    int units[SWEEP_MAX_CHOICES][SWEEP_MAX_LAYERS];
+    OptimizerType optimizers[SWEEP_MAX_CHOICES];
+    float rates[SWEEP_MAX_CHOICES];
+    int batchSizes[SWEEP_MAX_CHOICES];
+    void fillShape(int shape, SweepTrial* trial) const;
+};
+
+struct SweepConfig
+{
+    SweepConfig();
+
+    // Stop rules, schedule and precision of every Train call. Batch size,
+    // epochs, parallelism and validation rows are set per trial; an
+    // epoch-based schedule restarts with each rung.
+    TrainingConfig training;
+    int randomTrials;           // trials drawn from the space, 0 = the whole grid
+    unsigned int seed;          // weights, random trials and the validation split
+    float validationFraction;   // held-out share of the samples, ranked on
+
+    // Successive halving: every trial trains minEpochs epochs, the best
+    // 1 / eta by validation RMSE go on to eta times as many, and so on up
+    // to maxEpochs, which the winner always reaches (a single trial
+    // trains maxEpochs right away)
+    int minEpochs;
+    int maxEpochs;
+    int eta;
+    ThreadPool* pool;           // DefaultThreadPool() if null
+};
+
+struct SweepResult
+{
+    SweepTrial trial;           // with the learning rate actually used
+    float validationError;      // best validation RMSE over all its rungs, the one of Model(rank)
+    float trainError;           // training RMSE of its last epoch
+    int epochs;                 // trained over all rungs
+    double seconds;             // time spent in Train
+    int rung;                   // last rung it trained in
+    bool pruned;                // dropped by successive halving
+    TrainingStopReason reason;  // of its last Train call
+};
+
+// Trains many NeuralModel configurations at once, one Train call per
+// worker of the pool. The samples are shuffled and normalized into a single
+// copy that every trial reads; the models train without normalization of
+// their own, and the statistics are folded into them at the end, so every
+// model takes raw features.
+class HyperparameterSweep
+{
+public:
+    HyperparameterSweep();
+    ~HyperparameterSweep();
+    // Samples are row-major with dimension features. False if the space,
+    // the samples or the classes are empty.
+    bool Run(const SweepSpace& space, const float* trainingData, const int* targetLabels, int sampleCount,
+        int dimension, int classCount, const SweepConfig& config);
+
+    int TrialCount() const { return trialCount; }
+    // Ranked by validation RMSE, then training time: rank 0 is the best
+    const SweepResult& Result(int rank) const { return results[ranking[rank]]; }
+    const NeuralModel& Model(int rank) const;
+private:
+    void release();
+    int trialCount;
+    SweepResult* results;
+    NeuralModel* models;
+    Optimizer** optimizers;
+    int* ranking;
+    HyperparameterSweep(const HyperparameterSweep&);
+    HyperparameterSweep& operator=(const HyperparameterSweep&);
+};
@@ -0,0 +1,1023 @@
+#include "pch.h"
+#include "Kernels.h"
+#include <math.h>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define KERNEL_TARGET(isa)
+#else
+#include <cpuid.h>
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+// ---------------------------------------------------------------- scalar
+
+static float dot_scalar(const float* a, const float* b, int n)
+{
+    float sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static void axpy_scalar(float alpha, const float* x, float* y, int n)
+{
+    for (int i = 0; i < n; i++)
+        y[i] += alpha * x[i];
+}
+
+static void momentum_scalar(float alpha, const float* x, float* w, float* v, float mu, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        v[i] = mu * v[i] + alpha * x[i];
+        w[i] += v[i];
+    }
+}
+
+static void gemv_int8_scalar(const signed char* w, int rows, int n, const signed char* x, const int* rowSums, int* out)
+{
+    (void)rowSums;
+    for (int r = 0; r < rows; r++)
+    {
+        const signed char* row = w + (size_t)r * n;
+        int sum = 0;
+        for (int k = 0; k < n; k++)
+            sum += row[k] * x[k];
+        out[r] = sum;
+    }
+}
+
+static inline unsigned int floatBits(float f)
+{
+    unsigned int u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static inline float bitsFloat(unsigned int u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// Round to nearest even; NaN stays a quiet NaN
+static inline unsigned short floatToBf16(float f)
+{
+    unsigned int u = floatBits(f);
+    if ((u & 0x7FFFFFFF) > 0x7F800000)
+        return (unsigned short)((u >> 16) | 0x40);
+    u += 0x7FFF + ((u >> 16) & 1);
+    return (unsigned short)(u >> 16);
+}
+
+static inline float bf16ToFloat(unsigned short h)
+{
+    return bitsFloat((unsigned int)h << 16);
+}
+
+// IEEE binary16, round to nearest even with subnormals; beyond 65504
+// rounds to infinity like F16C (after F. Giesen's float_to_half_fast3_rtne)
+static inline unsigned short floatToF16(float f)
+{
+    const unsigned int infinity = 255u << 23;
+    const unsigned int f16Max = (127u + 16) << 23;
+    const unsigned int denormMagic = ((127u - 15) + (23 - 10) + 1) << 23;
+    unsigned int u = floatBits(f);
+    unsigned int sign = u & 0x80000000u;
+    u ^= sign;
+
+    unsigned int h;
+    if (u >= f16Max)
+        h = (u > infinity) ? 0x7E00 | ((u >> 13) & 0x3FF) : 0x7C00; // NaNs keep their payload, like F16C
+    else if (u < (113u << 23))
+        h = floatBits(bitsFloat(u) + bitsFloat(denormMagic)) - denormMagic;
+    else
+    {
+        unsigned int mantissaOdd = (u >> 13) & 1;
+        u += ((unsigned int)(15 - 127) << 23) + 0xFFF + mantissaOdd;
+        h = u >> 13;
+    }
+    return (unsigned short)(h | (sign >> 16));
+}
+
+static inline float f16ToFloat(unsigned short h)
+{
+    const unsigned int shiftedExponent = 0x7C00u << 13;
+    unsigned int u = ((unsigned int)h & 0x7FFF) << 13;
+    unsigned int exponent = u & shiftedExponent;
+    u += (127u - 15) << 23;
+    if (exponent == shiftedExponent)
+        u += (128u - 16) << 23;             // Inf / NaN
+    else if (exponent == 0)
+        u = floatBits(bitsFloat(u + (1u << 23)) - bitsFloat(113u << 23)); // subnormal
+    return bitsFloat(u | (((unsigned int)h & 0x8000) << 16));
+}
+
+static void pack_f16_scalar(const float* x, unsigned short* out, int n)
+{
+    for (int i = 0; i < n; i++)
+        out[i] = floatToF16(x[i]);
+}
+
+static void unpack_f16_scalar(const unsigned short* x, float* out, int n)
+{
+    for (int i = 0; i < n; i++)
+        out[i] = f16ToFloat(x[i]);
+}
+
+static void pack_bf16_scalar(const float* x, unsigned short* out, int n)
+{
+    for (int i = 0; i < n; i++)
+        out[i] = floatToBf16(x[i]);
+}
+
+static void unpack_bf16_scalar(const unsigned short* x, float* out, int n)
+{
+    for (int i = 0; i < n; i++)
+        out[i] = bf16ToFloat(x[i]);
+}
+
+static void gemv_f16_scalar(const unsigned short* w, int rows, int n, const float* x, float* out)
+{
+    for (int r = 0; r < rows; r++)
+    {
+        const unsigned short* row = w + (size_t)r * n;
+        float sum = 0;
+        for (int k = 0; k < n; k++)
+            sum += f16ToFloat(row[k]) * x[k];
+        out[r] = sum;
+    }
+}
+
+static void gemv_bf16_scalar(const unsigned short* w, int rows, int n, const float* x, float* out)
+{
+    for (int r = 0; r < rows; r++)
+    {
+        const unsigned short* row = w + (size_t)r * n;
+        float sum = 0;
+        for (int k = 0; k < n; k++)
+            sum += bf16ToFloat(row[k]) * x[k];
+        out[r] = sum;
+    }
+}
+
+static void tanh_exact(float* x, int n)
+{
+    for (int i = 0; i < n; i++)
+        x[i] = (float)tanh(x[i]);
+}
+
+static void tanh_scalar(float* x, int n)
+{
+    for (int i = 0; i < n; i++)
+        x[i] = TanhRational(x[i]);
+}
+
+static void tanh_grad_scalar(const float* a, float* s, int n)
+{
+    for (int i = 0; i < n; i++)
+        s[i] *= 1 - a[i] * a[i];
+}
+
+#ifdef KERNELS_X86
+
+// ---------------------------------------------------------------- SSE2
+
+KERNEL_TARGET("sse2")
+static float dot_sse2(const float* a, const float* b, int n)
+{
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    if (i + 4 <= n)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        i += 4;
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+    float sum = _mm_cvtss_f32(acc0);
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+KERNEL_TARGET("sse2")
+static void axpy_sse2(float alpha, const float* x, float* y, int n)
+{
+    __m128 va = _mm_set1_ps(alpha);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+    for (; i < n; i++)
+        y[i] += alpha * x[i];
+}
+
+KERNEL_TARGET("sse2")
+static void momentum_sse2(float alpha, const float* x, float* w, float* v, float mu, int n)
+{
+    __m128 va = _mm_set1_ps(alpha);
+    __m128 vm = _mm_set1_ps(mu);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 vel = _mm_add_ps(_mm_mul_ps(vm, _mm_loadu_ps(v + i)), _mm_mul_ps(va, _mm_loadu_ps(x + i)));
+        _mm_storeu_ps(v + i, vel);
+        _mm_storeu_ps(w + i, _mm_add_ps(_mm_loadu_ps(w + i), vel));
+    }
+    for (; i < n; i++)
+    {
+        v[i] = mu * v[i] + alpha * x[i];
+        w[i] += v[i];
+    }
+}
+
+KERNEL_TARGET("sse2")
+static void tanh_sse2(float* x, int n)
+{
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 v = _mm_loadu_ps(x + i);
+        __m128 tiny = _mm_cmplt_ps(_mm_andnot_ps(signMask, v), _mm_set1_ps(TANH_TINY));
+        __m128 c = _mm_max_ps(_mm_min_ps(v, _mm_set1_ps(TANH_CLAMP)), _mm_set1_ps(-TANH_CLAMP));
+        __m128 x2 = _mm_mul_ps(c, c);
+        __m128 p = _mm_set1_ps(TANH_A13);
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(TANH_A11));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(TANH_A9));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(TANH_A7));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(TANH_A5));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(TANH_A3));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(TANH_A1));
+        __m128 q = _mm_set1_ps(TANH_B6);
+        q = _mm_add_ps(_mm_mul_ps(q, x2), _mm_set1_ps(TANH_B4));
+        q = _mm_add_ps(_mm_mul_ps(q, x2), _mm_set1_ps(TANH_B2));
+        q = _mm_add_ps(_mm_mul_ps(q, x2), _mm_set1_ps(TANH_B0));
+        __m128 r = _mm_div_ps(_mm_mul_ps(c, p), q);
+        _mm_storeu_ps(x + i, _mm_or_ps(_mm_and_ps(tiny, v), _mm_andnot_ps(tiny, r)));
+    }
+    for (; i < n; i++)
+        x[i] = TanhRational(x[i]);
+}
+
+KERNEL_TARGET("sse2")
+static void tanh_grad_sse2(const float* a, float* s, int n)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 va = _mm_loadu_ps(a + i);
+        _mm_storeu_ps(s + i, _mm_mul_ps(_mm_loadu_ps(s + i), _mm_sub_ps(one, _mm_mul_ps(va, va))));
+    }
+    for (; i < n; i++)
+        s[i] *= 1 - a[i] * a[i];
+}
+
+// Sign extends 16 bytes to two vectors of 8 int16 and multiplies pairwise
+// into int32: no saturation, unlike pmaddubsw
+KERNEL_TARGET("sse2")
+static void gemv_int8_sse2(const signed char* w, int rows, int n, const signed char* x, const int* rowSums, int* out)
+{
+    (void)rowSums;
+    for (int r = 0; r < rows; r++)
+    {
+        const signed char* row = w + (size_t)r * n;
+        __m128i acc = _mm_setzero_si128();
+        for (int k = 0; k < n; k += 16)
+        {
+            __m128i vx = _mm_loadu_si128((const __m128i*)(x + k));
+            __m128i vw = _mm_loadu_si128((const __m128i*)(row + k));
+            __m128i xLo = _mm_srai_epi16(_mm_unpacklo_epi8(vx, vx), 8);
+            __m128i xHi = _mm_srai_epi16(_mm_unpackhi_epi8(vx, vx), 8);
+            __m128i wLo = _mm_srai_epi16(_mm_unpacklo_epi8(vw, vw), 8);
+            __m128i wHi = _mm_srai_epi16(_mm_unpackhi_epi8(vw, vw), 8);
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(xLo, wLo));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(xHi, wHi));
+        }
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+        out[r] = _mm_cvtsi128_si32(acc);
+    }
+}
+
+// ---------------------------------------------------------------- AVX2 + FMA
+
+KERNEL_TARGET("avx2,fma")
+static float dot_avx2(const float* a, const float* b, int n)
+{
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    if (i + 8 <= n)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        i += 8;
+    }
+    acc0 = _mm256_add_ps(acc0, acc1);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    float sum = _mm_cvtss_f32(s);
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+KERNEL_TARGET("avx2,fma")
+static void axpy_avx2(float alpha, const float* x, float* y, int n)
+{
+    __m256 va = _mm256_set1_ps(alpha);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+    for (; i < n; i++)
+        y[i] += alpha * x[i];
+}
+
+KERNEL_TARGET("avx2,fma")
+static void momentum_avx2(float alpha, const float* x, float* w, float* v, float mu, int n)
+{
+    __m256 va = _mm256_set1_ps(alpha);
+    __m256 vm = _mm256_set1_ps(mu);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 vel = _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_mul_ps(vm, _mm256_loadu_ps(v + i)));
+        _mm256_storeu_ps(v + i, vel);
+        _mm256_storeu_ps(w + i, _mm256_add_ps(_mm256_loadu_ps(w + i), vel));
+    }
+    for (; i < n; i++)
+    {
+        v[i] = mu * v[i] + alpha * x[i];
+        w[i] += v[i];
+    }
+}
+
+KERNEL_TARGET("avx2,fma")
+static inline __m256 tanh8_avx2(__m256 v)
+{
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    __m256 tiny = _mm256_cmp_ps(_mm256_andnot_ps(signMask, v), _mm256_set1_ps(TANH_TINY), _CMP_LT_OQ);
+    __m256 c = _mm256_max_ps(_mm256_min_ps(v, _mm256_set1_ps(TANH_CLAMP)), _mm256_set1_ps(-TANH_CLAMP));
+    __m256 x2 = _mm256_mul_ps(c, c);
+    __m256 p = _mm256_set1_ps(TANH_A13);
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(TANH_A11));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(TANH_A9));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(TANH_A7));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(TANH_A5));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(TANH_A3));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(TANH_A1));
+    __m256 q = _mm256_set1_ps(TANH_B6);
+    q = _mm256_fmadd_ps(q, x2, _mm256_set1_ps(TANH_B4));
+    q = _mm256_fmadd_ps(q, x2, _mm256_set1_ps(TANH_B2));
+    q = _mm256_fmadd_ps(q, x2, _mm256_set1_ps(TANH_B0));
+    return _mm256_blendv_ps(_mm256_div_ps(_mm256_mul_ps(c, p), q), v, tiny);
+}
+
+KERNEL_TARGET("avx2,fma")
+static void tanh_avx2(float* x, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(x + i, tanh8_avx2(_mm256_loadu_ps(x + i)));
+    if (i < n)
+    {
+        // Tail through one padded vector so narrow layers stay vectorized
+        alignas(32) float lanes[8] = { 0 };
+        for (int k = 0; k < n - i; k++)
+            lanes[k] = x[i + k];
+        _mm256_store_ps(lanes, tanh8_avx2(_mm256_load_ps(lanes)));
+        for (int k = 0; k < n - i; k++)
+            x[i + k] = lanes[k];
+    }
+}
+
+KERNEL_TARGET("avx2,fma")
+static void tanh_grad_avx2(const float* a, float* s, int n)
+{
+    __m256 one = _mm256_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 va = _mm256_loadu_ps(a + i);
+        _mm256_storeu_ps(s + i, _mm256_mul_ps(_mm256_loadu_ps(s + i), _mm256_fnmadd_ps(va, va, one)));
+    }
+    for (; i < n; i++)
+        s[i] *= 1 - a[i] * a[i];
+}
+
+// Four rows at a time share every extended block of x; their sums are
+// reduced together with two rounds of hadd
+KERNEL_TARGET("avx2")
+static void gemv_int8_avx2(const signed char* w, int rows, int n, const signed char* x, const int* rowSums, int* out)
+{
+    (void)rowSums;
+    int r = 0;
+    for (; r + 4 <= rows; r += 4)
+    {
+        const signed char* row = w + (size_t)r * n;
+        __m256i acc0 = _mm256_setzero_si256();
+        __m256i acc1 = _mm256_setzero_si256();
+        __m256i acc2 = _mm256_setzero_si256();
+        __m256i acc3 = _mm256_setzero_si256();
+        for (int k = 0; k < n; k += 16)
+        {
+            __m256i vx = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(x + k)));
+            acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(vx, _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(row + k)))));
+            acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(vx, _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(row + n + k)))));
+            acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(vx, _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(row + 2 * n + k)))));
+            acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(vx, _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(row + 3 * n + k)))));
+        }
+        __m256i s = _mm256_hadd_epi32(_mm256_hadd_epi32(acc0, acc1), _mm256_hadd_epi32(acc2, acc3));
+        __m128i sums = _mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+        _mm_storeu_si128((__m128i*)(out + r), sums);
+    }
+    for (; r < rows; r++)
+    {
+        const signed char* row = w + (size_t)r * n;
+        __m256i acc = _mm256_setzero_si256();
+        for (int k = 0; k < n; k += 16)
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(x + k))),
+                _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(row + k)))));
+        __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+        out[r] = _mm_cvtsi128_si32(s);
+    }
+}
+
+// Sums of four accumulators, one per lane of the result
+KERNEL_TARGET("avx2")
+static inline __m128 reduce4_avx2(__m256 a0, __m256 a1, __m256 a2, __m256 a3)
+{
+    __m256 s = _mm256_hadd_ps(_mm256_hadd_ps(a0, a1), _mm256_hadd_ps(a2, a3));
+    return _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+}
+
+KERNEL_TARGET("avx2")
+static inline float reduce_avx2(__m256 a)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+KERNEL_TARGET("avx2,f16c")
+static inline __m256 load_f16_avx2(const unsigned short* p)
+{
+    return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)p));
+}
+
+KERNEL_TARGET("avx2")
+static inline __m256 load_bf16_avx2(const unsigned short* p)
+{
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)), 16));
+}
+
+// Four rows at a time share every block of x, like gemv_int8_avx2
+KERNEL_TARGET("avx2,fma,f16c")
+static void gemv_f16_avx2(const unsigned short* w, int rows, int n, const float* x, float* out)
+{
+    int r = 0;
+    for (; r + 4 <= rows; r += 4)
+    {
+        const unsigned short* row = w + (size_t)r * n;
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+        for (int k = 0; k < n; k += 8)
+        {
+            __m256 vx = _mm256_loadu_ps(x + k);
+            acc0 = _mm256_fmadd_ps(load_f16_avx2(row + k), vx, acc0);
+            acc1 = _mm256_fmadd_ps(load_f16_avx2(row + n + k), vx, acc1);
+            acc2 = _mm256_fmadd_ps(load_f16_avx2(row + 2 * n + k), vx, acc2);
+            acc3 = _mm256_fmadd_ps(load_f16_avx2(row + 3 * n + k), vx, acc3);
+        }
+        _mm_storeu_ps(out + r, reduce4_avx2(acc0, acc1, acc2, acc3));
+    }
+    for (; r < rows; r++)
+    {
+        const unsigned short* row = w + (size_t)r * n;
+        __m256 acc = _mm256_setzero_ps();
+        for (int k = 0; k < n; k += 8)
+            acc = _mm256_fmadd_ps(load_f16_avx2(row + k), _mm256_loadu_ps(x + k), acc);
+        out[r] = reduce_avx2(acc);
+    }
+}
+
+KERNEL_TARGET("avx2,fma")
+static void gemv_bf16_avx2(const unsigned short* w, int rows, int n, const float* x, float* out)
+{
+    int r = 0;
+    for (; r + 4 <= rows; r += 4)
+    {
+        const unsigned short* row = w + (size_t)r * n;
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+        for (int k = 0; k < n; k += 8)
+        {
+            __m256 vx = _mm256_loadu_ps(x + k);
+            acc0 = _mm256_fmadd_ps(load_bf16_avx2(row + k), vx, acc0);
+            acc1 = _mm256_fmadd_ps(load_bf16_avx2(row + n + k), vx, acc1);
+            acc2 = _mm256_fmadd_ps(load_bf16_avx2(row + 2 * n + k), vx, acc2);
+            acc3 = _mm256_fmadd_ps(load_bf16_avx2(row + 3 * n + k), vx, acc3);
+        }
+        _mm_storeu_ps(out + r, reduce4_avx2(acc0, acc1, acc2, acc3));
+    }
+    for (; r < rows; r++)
+    {
+        const unsigned short* row = w + (size_t)r * n;
+        __m256 acc = _mm256_setzero_ps();
+        for (int k = 0; k < n; k += 8)
+            acc = _mm256_fmadd_ps(load_bf16_avx2(row + k), _mm256_loadu_ps(x + k), acc);
+        out[r] = reduce_avx2(acc);
+    }
+}
+
+KERNEL_TARGET("avx2,f16c")
+static void pack_f16_avx2(const float* x, unsigned short* out, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128((__m128i*)(out + i), _mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    for (; i < n; i++)
+        out[i] = floatToF16(x[i]);
+}
+
+KERNEL_TARGET("avx2,f16c")
+static void unpack_f16_avx2(const unsigned short* h, float* out, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(out + i, load_f16_avx2(h + i));
+    for (; i < n; i++)
+        out[i] = f16ToFloat(h[i]);
+}
+
+// floatToBf16 on eight lanes
+KERNEL_TARGET("avx2")
+static void pack_bf16_avx2(const float* x, unsigned short* out, int n)
+{
+    const __m256i roundBias = _mm256_set1_epi32(0x7FFF);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i absMask = _mm256_set1_epi32(0x7FFFFFFF);
+    const __m256i infinity = _mm256_set1_epi32(0x7F800000);
+    const __m256i quietBit = _mm256_set1_epi32(0x40);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i u = _mm256_castps_si256(_mm256_loadu_ps(x + i));
+        __m256i high = _mm256_srli_epi32(u, 16);
+        __m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(u, _mm256_add_epi32(roundBias, _mm256_and_si256(high, one))), 16);
+        __m256i nan = _mm256_cmpgt_epi32(_mm256_and_si256(u, absMask), infinity);
+        __m256i v = _mm256_blendv_epi8(rounded, _mm256_or_si256(high, quietBit), nan);
+        // packus interleaves the 128 bit halves; gather the two low quads
+        v = _mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(out + i), _mm256_castsi256_si128(v));
+    }
+    for (; i < n; i++)
+        out[i] = floatToBf16(x[i]);
+}
+
+KERNEL_TARGET("avx2")
+static void unpack_bf16_avx2(const unsigned short* h, float* out, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(out + i, load_bf16_avx2(h + i));
+    for (; i < n; i++)
+        out[i] = bf16ToFloat(h[i]);
+}
+
+// ---------------------------------------------------------------- AVX-512F
+
+KERNEL_TARGET("avx512f")
+static float dot_avx512(const float* a, const float* b, int n)
+{
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+    }
+    for (; i + 16 <= n; i += 16)
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+    if (i < n)
+    {
+        __mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i), acc1);
+    }
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, _mm512_add_ps(acc0, acc1));
+    for (int w = 8; w > 0; w >>= 1)
+        for (int k = 0; k < w; k++)
+            lanes[k] += lanes[k + w];
+    return lanes[0];
+}
+
+KERNEL_TARGET("avx512f")
+static void axpy_avx512(float alpha, const float* x, float* y, int n)
+{
+    __m512 va = _mm512_set1_ps(alpha);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+    if (i < n)
+    {
+        __mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(y + i, m,
+            _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, x + i), _mm512_maskz_loadu_ps(m, y + i)));
+    }
+}
+
+KERNEL_TARGET("avx512f")
+static void momentum_avx512(float alpha, const float* x, float* w, float* v, float mu, int n)
+{
+    __m512 va = _mm512_set1_ps(alpha);
+    __m512 vm = _mm512_set1_ps(mu);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512 vel = _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_mul_ps(vm, _mm512_loadu_ps(v + i)));
+        _mm512_storeu_ps(v + i, vel);
+        _mm512_storeu_ps(w + i, _mm512_add_ps(_mm512_loadu_ps(w + i), vel));
+    }
+    if (i < n)
+    {
+        __mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+        __m512 vel = _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, x + i), _mm512_mul_ps(vm, _mm512_maskz_loadu_ps(m, v + i)));
+        _mm512_mask_storeu_ps(v + i, m, vel);
+        _mm512_mask_storeu_ps(w + i, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, w + i), vel));
+    }
+}
+
+KERNEL_TARGET("avx512f")
+static void tanh_avx512(float* x, int n)
+{
+    const __m512 clampHi = _mm512_set1_ps(TANH_CLAMP);
+    const __m512 clampLo = _mm512_set1_ps(-TANH_CLAMP);
+    for (int i = 0; i < n; i += 16)
+    {
+        __mmask16 m = (n - i >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+        __m512 v = _mm512_maskz_loadu_ps(m, x + i);
+        __mmask16 tiny = _mm512_cmp_ps_mask(_mm512_abs_ps(v), _mm512_set1_ps(TANH_TINY), _CMP_LT_OQ);
+        __m512 c = _mm512_max_ps(_mm512_min_ps(v, clampHi), clampLo);
+        __m512 x2 = _mm512_mul_ps(c, c);
+        __m512 p = _mm512_set1_ps(TANH_A13);
+        p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(TANH_A11));
+        p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(TANH_A9));
+        p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(TANH_A7));
+        p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(TANH_A5));
+        p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(TANH_A3));
+        p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(TANH_A1));
+        __m512 q = _mm512_set1_ps(TANH_B6);
+        q = _mm512_fmadd_ps(q, x2, _mm512_set1_ps(TANH_B4));
+        q = _mm512_fmadd_ps(q, x2, _mm512_set1_ps(TANH_B2));
+        q = _mm512_fmadd_ps(q, x2, _mm512_set1_ps(TANH_B0));
+        __m512 r = _mm512_mask_mov_ps(_mm512_div_ps(_mm512_mul_ps(c, p), q), tiny, v);
+        _mm512_mask_storeu_ps(x + i, m, r);
+    }
+}
+
+KERNEL_TARGET("avx512f")
+static void tanh_grad_avx512(const float* a, float* s, int n)
+{
+    __m512 one = _mm512_set1_ps(1.0f);
+    for (int i = 0; i < n; i += 16)
+    {
+        __mmask16 m = (n - i >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+        __m512 va = _mm512_maskz_loadu_ps(m, a + i);
+        __m512 vs = _mm512_maskz_loadu_ps(m, s + i);
+        _mm512_mask_storeu_ps(s + i, m, _mm512_mul_ps(vs, _mm512_fnmadd_ps(va, va, one)));
+    }
+}
+
+KERNEL_TARGET("avx512f")
+static inline __m512 load_f16_avx512(const unsigned short* p)
+{
+    return _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)p));
+}
+
+KERNEL_TARGET("avx512f")
+static inline __m512 load_bf16_avx512(const unsigned short* p)
+{
+    return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)p)), 16));
+}
+
+KERNEL_TARGET("avx512f")
+static void gemv_f16_avx512(const unsigned short* w, int rows, int n, const float* x, float* out)
+{
+    for (int r = 0; r < rows; r += 4)
+    {
+        int count = (rows - r < 4) ? rows - r : 4;
+        const unsigned short* row = w + (size_t)r * n;
+        __m512 acc[4] = { _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps() };
+        for (int k = 0; k < n; k += 16)
+        {
+            __m512 vx = _mm512_loadu_ps(x + k);
+            for (int i = 0; i < count; i++)
+                acc[i] = _mm512_fmadd_ps(load_f16_avx512(row + (size_t)i * n + k), vx, acc[i]);
+        }
+        for (int i = 0; i < count; i++)
+            out[r + i] = _mm512_reduce_add_ps(acc[i]);
+    }
+}
+
+KERNEL_TARGET("avx512f")
+static void gemv_bf16_avx512(const unsigned short* w, int rows, int n, const float* x, float* out)
+{
+    for (int r = 0; r < rows; r += 4)
+    {
+        int count = (rows - r < 4) ? rows - r : 4;
+        const unsigned short* row = w + (size_t)r * n;
+        __m512 acc[4] = { _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps() };
+        for (int k = 0; k < n; k += 16)
+        {
+            __m512 vx = _mm512_loadu_ps(x + k);
+            for (int i = 0; i < count; i++)
+                acc[i] = _mm512_fmadd_ps(load_bf16_avx512(row + (size_t)i * n + k), vx, acc[i]);
+        }
+        for (int i = 0; i < count; i++)
+            out[r + i] = _mm512_reduce_add_ps(acc[i]);
+    }
+}
+
+KERNEL_TARGET("avx512f")
+static void pack_f16_avx512(const float* x, unsigned short* out, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm256_storeu_si256((__m256i*)(out + i), _mm512_cvtps_ph(_mm512_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    for (; i < n; i++)
+        out[i] = floatToF16(x[i]);
+}
+
+KERNEL_TARGET("avx512f")
+static void unpack_f16_avx512(const unsigned short* h, float* out, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(out + i, load_f16_avx512(h + i));
+    for (; i < n; i++)
+        out[i] = f16ToFloat(h[i]);
+}
+
+// floatToBf16 on sixteen lanes, for CPUs without AVX512-BF16
+KERNEL_TARGET("avx512f")
+static void pack_bf16_avx512(const float* x, unsigned short* out, int n)
+{
+    const __m512i roundBias = _mm512_set1_epi32(0x7FFF);
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i absMask = _mm512_set1_epi32(0x7FFFFFFF);
+    const __m512i infinity = _mm512_set1_epi32(0x7F800000);
+    const __m512i quietBit = _mm512_set1_epi32(0x40);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512i u = _mm512_castps_si512(_mm512_loadu_ps(x + i));
+        __m512i high = _mm512_srli_epi32(u, 16);
+        __m512i v = _mm512_srli_epi32(_mm512_add_epi32(u, _mm512_add_epi32(roundBias, _mm512_and_si512(high, one))), 16);
+        __mmask16 nan = _mm512_cmpgt_epu32_mask(_mm512_and_si512(u, absMask), infinity);
+        v = _mm512_mask_mov_epi32(v, nan, _mm512_or_si512(high, quietBit));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm512_cvtepi32_epi16(v));
+    }
+    for (; i < n; i++)
+        out[i] = floatToBf16(x[i]);
+}
+
+// vcvtneps2bf16 rounds to nearest even but flushes subnormal inputs to
+// zero, so values below 1.2e-38 may differ from the other levels
+KERNEL_TARGET("avx512f,avx512bf16")
+static void pack_bf16_avx512bf16(const float* x, unsigned short* out, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256bh packed = _mm512_cvtneps_pbh(_mm512_loadu_ps(x + i));
+        memcpy(out + i, &packed, sizeof(packed));
+    }
+    for (; i < n; i++)
+        out[i] = floatToBf16(x[i]);
+}
+
+KERNEL_TARGET("avx512f")
+static void unpack_bf16_avx512(const unsigned short* h, float* out, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(out + i, load_bf16_avx512(h + i));
+    for (; i < n; i++)
+        out[i] = bf16ToFloat(h[i]);
+}
+
+// vpdpbusd multiplies unsigned by signed bytes: x ^ 0x80 is x + 128 as an
+// unsigned byte, and the 128 * rowSums[r] that adds is subtracted at the
+// end. A partial last block is loaded masked (zero weights).
+KERNEL_TARGET("avx512f,avx512bw,avx512vnni")
+static void gemv_int8_vnni(const signed char* w, int rows, int n, const signed char* x, const int* rowSums, int* out)
+{
+    __m512i bias = _mm512_set1_epi8((char)0x80);
+    int full = n & ~63;
+    __mmask64 tail = (n > full) ? ((1ULL << (n - full)) - 1) : 0;
+
+    int r = 0;
+    for (; r < rows; r += 4)
+    {
+        int count = (rows - r < 4) ? rows - r : 4;
+        const signed char* row = w + (size_t)r * n;
+        __m512i acc[4] = { _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512(), _mm512_setzero_si512() };
+        for (int k = 0; k < full; k += 64)
+        {
+            __m512i vx = _mm512_xor_si512(_mm512_loadu_si512(x + k), bias);
+            for (int i = 0; i < count; i++)
+                acc[i] = _mm512_dpbusd_epi32(acc[i], vx, _mm512_loadu_si512(row + (size_t)i * n + k));
+        }
+        if (tail)
+        {
+            __m512i vx = _mm512_xor_si512(_mm512_maskz_loadu_epi8(tail, x + full), bias);
+            for (int i = 0; i < count; i++)
+                acc[i] = _mm512_dpbusd_epi32(acc[i], vx, _mm512_maskz_loadu_epi8(tail, row + (size_t)i * n + full));
+        }
+        for (int i = 0; i < count; i++)
+            out[r + i] = _mm512_reduce_add_epi32(acc[i]) - 128 * rowSums[r + i];
+    }
+}
+
+// ---------------------------------------------------------------- CPUID
+
+static void cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, leaf, subleaf);
+    for (int i = 0; i < 4; i++)
+        regs[i] = (unsigned int)r[i];
+#else
+    if (!__get_cpuid_count((unsigned int)leaf, (unsigned int)subleaf, &regs[0], &regs[1], &regs[2], &regs[3]))
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+}
+
+static unsigned long long xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+
+// AVX-512 VNNI (and BW for the byte loads) on top of KERNEL_AVX512
+static bool detectAvx512Vnni()
+{
+    unsigned int r[4];
+    cpuid(0, 0, r);
+    if (r[0] < 7)
+        return false;
+    cpuid(7, 0, r);
+    return ((r[1] >> 30) & 1) && ((r[2] >> 11) & 1);
+}
+
+// F16C conversions next to AVX2
+static bool detectF16c()
+{
+    unsigned int r[4];
+    cpuid(1, 0, r);
+    return (r[2] >> 29) & 1;
+}
+
+// AVX512-BF16 (vcvtneps2bf16) on top of KERNEL_AVX512
+static bool detectAvx512Bf16()
+{
+    unsigned int r[4];
+    cpuid(0, 0, r);
+    if (r[0] < 7)
+        return false;
+    cpuid(7, 0, r);
+    if (r[0] < 1)
+        return false;
+    cpuid(7, 1, r);
+    return (r[0] >> 5) & 1;
+}
+
+#endif // KERNELS_X86
+
+KernelLevel DetectKernelLevel()
+{
+#ifdef KERNELS_X86
+    unsigned int r1[4], r7[4];
+    cpuid(0, 0, r1);
+    unsigned int maxLeaf = r1[0];
+    cpuid(1, 0, r1);
+    if (maxLeaf >= 7)
+        cpuid(7, 0, r7);
+    else
+        r7[0] = r7[1] = r7[2] = r7[3] = 0;
+
+    bool sse2 = (r1[3] >> 26) & 1;
+    bool osxsave = (r1[2] >> 27) & 1;
+    bool avx = (r1[2] >> 28) & 1;
+    bool fma = (r1[2] >> 12) & 1;
+    bool avx2 = (r7[1] >> 5) & 1;
+    bool avx512f = (r7[1] >> 16) & 1;
+
+    // The OS must save the YMM (and ZMM/opmask) state on context switches
+    unsigned long long xcr0 = osxsave ? xgetbv0() : 0;
+    bool ymmState = (xcr0 & 0x6) == 0x6;
+    bool zmmState = (xcr0 & 0xE6) == 0xE6;
+
+    if (avx512f && ymmState && zmmState)
+        return KERNEL_AVX512;
+    if (avx && avx2 && fma && ymmState)
+        return KERNEL_AVX2;
+    if (sse2)
+        return KERNEL_SSE2;
+#endif
+    return KERNEL_SCALAR;
+}
+
+static ActivationAccuracy s_activationAccuracy = ACTIVATION_FAST;
+
+static KernelTable MakeTable(KernelLevel level)
+{
+    KernelTable table = { KERNEL_SCALAR, "scalar", dot_scalar, axpy_scalar, momentum_scalar, tanh_scalar, tanh_grad_scalar,
+        gemv_int8_scalar, gemv_f16_scalar, gemv_bf16_scalar, pack_f16_scalar, unpack_f16_scalar, pack_bf16_scalar,
+        unpack_bf16_scalar };
+#ifdef KERNELS_X86
+    switch (level)
+    {
+    case KERNEL_AVX512:
+        table = { KERNEL_AVX512, "avx512", dot_avx512, axpy_avx512, momentum_avx512, tanh_avx512, tanh_grad_avx512,
+            detectAvx512Vnni() ? gemv_int8_vnni : gemv_int8_avx2, gemv_f16_avx512, gemv_bf16_avx512, pack_f16_avx512,
+            unpack_f16_avx512, detectAvx512Bf16() ? pack_bf16_avx512bf16 : pack_bf16_avx512, unpack_bf16_avx512 };
+        break;
+    case KERNEL_AVX2:
+        table = { KERNEL_AVX2, "avx2", dot_avx2, axpy_avx2, momentum_avx2, tanh_avx2, tanh_grad_avx2, gemv_int8_avx2,
+            gemv_f16_scalar, gemv_bf16_avx2, pack_f16_scalar, unpack_f16_scalar, pack_bf16_avx2, unpack_bf16_avx2 };
+        if (detectF16c())
+        {
+            table.gemvF16 = gemv_f16_avx2;
+            table.packF16 = pack_f16_avx2;
+            table.unpackF16 = unpack_f16_avx2;
+        }
+        break;
+    case KERNEL_SSE2:
+        // 16-bit weights stay scalar: no F16C below AVX2
+        table = { KERNEL_SSE2, "sse2", dot_sse2, axpy_sse2, momentum_sse2, tanh_sse2, tanh_grad_sse2, gemv_int8_sse2,
+            gemv_f16_scalar, gemv_bf16_scalar, pack_f16_scalar, unpack_f16_scalar, pack_bf16_scalar, unpack_bf16_scalar };
+        break;
+    default: break;
+    }
+#else
+    (void)level;
+#endif
+    if (s_activationAccuracy == ACTIVATION_EXACT)
+        table.tanh = tanh_exact;
+    return table;
+}
+
+KernelTable g_kernels = MakeTable(DetectKernelLevel());
+
+KernelLevel SelectKernels(KernelLevel level)
+{
+    KernelLevel best = DetectKernelLevel();
+    if (level > best)
+        level = best;
+    g_kernels = MakeTable(level);
+    return level;
+}
+
+void SelectActivationAccuracy(ActivationAccuracy accuracy)
+{
+    s_activationAccuracy = accuracy;
+    g_kernels = MakeTable(g_kernels.level);
+}
+
+ActivationAccuracy CurrentActivationAccuracy()
+{
+    return s_activationAccuracy;
+}
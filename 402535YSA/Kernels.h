@@ -0,0 +1,131 @@
+#pragma once
+#include <math.h>
+
+// Vector kernels used by the training and test loops. One variant per
+// instruction set is compiled in; the best one the CPU (and OS) supports is
+// picked through CPUID when the program starts.
+//
+// Tolerance: the scalar variant sums in index order, exactly like the
+// original loops. The SIMD variants keep 4/8/16 partial sums and use FMA, so
+// for a dot product of length n they may differ from the scalar result by
+// at most KERNEL_DOT_TOLERANCE * n * sum(|a[i] * b[i]|). axpy and momentum
+// results differ by at most one rounding (FMA vs. multiply + add) per
+// operation and element.
+#define KERNEL_DOT_TOLERANCE 1.2e-7f
+
+// Fast tanh is a [13/6] rational approximation, clamped to +-1 beyond
+// |x| = 7.9; its error against double precision tanh is at most
+// KERNEL_TANH_TOLERANCE (absolute) for every finite float input (measured
+// 4.1e-7 scalar/SSE2, 2.9e-7 with FMA). The exact mode calls tanh() per
+// element like the original loops and is meant for validation runs.
+#define KERNEL_TANH_TOLERANCE 5e-7f
+
+// tanh(x) ~= x * P(x^2) / Q(x^2) for |x| <= TANH_CLAMP; beyond that tanh
+// is within one float rounding of +-1, which the clamp produces. Below
+// TANH_TINY tanh(x) rounds to x.
+#define TANH_CLAMP 7.90531110763549805f
+#define TANH_TINY 0.0004f
+#define TANH_A1 4.89352455891786e-03f
+#define TANH_A3 6.37261928875436e-04f
+#define TANH_A5 1.48572235717979e-05f
+#define TANH_A7 5.12229709037114e-08f
+#define TANH_A9 -8.60467152213735e-11f
+#define TANH_A11 2.00018790482477e-13f
+#define TANH_A13 -2.76076847742355e-16f
+#define TANH_B0 4.89352518554385e-03f
+#define TANH_B2 2.26843463243900e-03f
+#define TANH_B4 1.18534705686654e-04f
+#define TANH_B6 1.19825839466702e-06f
+
+// Scalar fast tanh, the reference of every vectorized variant; inline for
+// callers that activate a few units at a time (StaticNetwork)
+inline float TanhRational(float x)
+{
+    // Selects instead of early returns: saturated units are common and a
+    // branching clamp mispredicts on them. NaN passes through the last one.
+    float c = (x < TANH_CLAMP) ? x : TANH_CLAMP;
+    c = (c > -TANH_CLAMP) ? c : -TANH_CLAMP;
+    float x2 = c * c;
+    float p = TANH_A13;
+    p = p * x2 + TANH_A11;
+    p = p * x2 + TANH_A9;
+    p = p * x2 + TANH_A7;
+    p = p * x2 + TANH_A5;
+    p = p * x2 + TANH_A3;
+    p = p * x2 + TANH_A1;
+    float q = TANH_B6;
+    q = q * x2 + TANH_B4;
+    q = q * x2 + TANH_B2;
+    q = q * x2 + TANH_B0;
+    float r = c * p / q;
+    return (fabsf(x) >= TANH_TINY) ? r : x;
+}
+
+// Integer products are exact on every level. Row lengths must be a
+// multiple of KERNEL_INT8_BLOCK; callers pad rows with zeros.
+#define KERNEL_INT8_BLOCK 16
+
+// Row lengths of the 16-bit weight products must be a multiple of this;
+// callers pad rows and inputs with zeros
+#define KERNEL_HALF_BLOCK 16
+
+enum KernelLevel
+{
+    KERNEL_SCALAR = 0,
+    KERNEL_SSE2,
+    KERNEL_AVX2,
+    KERNEL_AVX512
+};
+
+enum ActivationAccuracy
+{
+    ACTIVATION_FAST = 0,
+    ACTIVATION_EXACT
+};
+
+struct KernelTable
+{
+    KernelLevel level;
+    const char* name;
+    // returns sum(a[i] * b[i])
+    float (*dot)(const float* a, const float* b, int n);
+    // y[i] += alpha * x[i]
+    void (*axpy)(float alpha, const float* x, float* y, int n);
+    // v[i] = mu * v[i] + alpha * x[i]; w[i] += v[i]  (fused momentum step)
+    void (*momentum)(float alpha, const float* x, float* w, float* v, float mu, int n);
+    // x[i] = tanh(x[i])
+    void (*tanh)(float* x, int n);
+    // s[i] *= 1 - a[i]^2  (tanh derivative from the activation)
+    void (*tanhGrad)(const float* a, float* s, int n);
+    // out[r] = sum(w[r * n + k] * x[k]) over int8 rows, in int32: pmaddwd
+    // on sign-extended bytes (SSE2 / AVX2), vpdpbusd where AVX-512 VNNI
+    // exists. rowSums[r] = sum(w[r * n + k]) corrects the unsigned shift of
+    // x that vpdpbusd needs.
+    void (*gemvInt8)(const signed char* w, int rows, int n, const signed char* x, const int* rowSums, int* out);
+    // out[r] = sum(w[r * n + k] * x[k]) over rows of 16-bit floats (IEEE
+    // half / bfloat16) widened to fp32 and accumulated in fp32. Half uses
+    // F16C or AVX-512 conversions; bfloat16 is the high half of a float.
+    void (*gemvF16)(const unsigned short* w, int rows, int n, const float* x, float* out);
+    void (*gemvBf16)(const unsigned short* w, int rows, int n, const float* x, float* out);
+    // 16-bit encodings rounded to nearest even, and back. Packing bfloat16
+    // uses vcvtneps2bf16 where AVX512-BF16 exists.
+    void (*packF16)(const float* x, unsigned short* out, int n);
+    void (*unpackF16)(const unsigned short* h, float* out, int n);
+    void (*packBf16)(const float* x, unsigned short* out, int n);
+    void (*unpackBf16)(const unsigned short* h, float* out, int n);
+};
+
+// Active kernel set, selected by CPUID before main() runs
+extern KernelTable g_kernels;
+
+// Highest level supported by this CPU and OS
+KernelLevel DetectKernelLevel();
+
+// Forces a level (clamped to what the CPU supports), e.g. KERNEL_SCALAR for
+// validation runs. Returns the level actually selected.
+KernelLevel SelectKernels(KernelLevel level);
+
+// Switches g_kernels.tanh between the vectorized approximation (default)
+// and the exact library call. Kept across SelectKernels calls.
+void SelectActivationAccuracy(ActivationAccuracy accuracy);
+ActivationAccuracy CurrentActivationAccuracy();
@@ -0,0 +1,104 @@
+#include "pch.h"
+#include "MatrixOps.h"
+#include "Kernels.h"
+
+static inline int min_int(int a, int b) { return a < b ? a : b; }
+
+static void scale_matrix(int M, int N, float beta, float* C, int ldc)
+{
+    if (beta == 1.0f)
+        return;
+    for (int i = 0; i < M; i++)
+    {
+        float* row = C + (size_t)i * ldc;
+        if (beta == 0.0f)
+            for (int j = 0; j < N; j++)
+                row[j] = 0.0f;
+        else
+            for (int j = 0; j < N; j++)
+                row[j] *= beta;
+    }
+}
+
+void gemm_nt(int M, int N, int K, float alpha, const float* A, int lda,
+    const float* B, int ldb, float beta, float* C, int ldc)
+{
+    scale_matrix(M, N, beta, C, ldc);
+
+    for (int p0 = 0; p0 < K; p0 += GEMM_BLOCK_K)
+    {
+        int pEnd = min_int(p0 + GEMM_BLOCK_K, K);
+        for (int j0 = 0; j0 < N; j0 += GEMM_BLOCK_N)
+        {
+            int jEnd = min_int(j0 + GEMM_BLOCK_N, N);
+            for (int i0 = 0; i0 < M; i0 += GEMM_BLOCK_M)
+            {
+                int iEnd = min_int(i0 + GEMM_BLOCK_M, M);
+                for (int i = i0; i < iEnd; i++)
+                {
+                    const float* a = A + (size_t)i * lda;
+                    float* c = C + (size_t)i * ldc;
+                    for (int j = j0; j < jEnd; j++)
+                    {
+                        const float* b = B + (size_t)j * ldb;
+                        c[j] += alpha * g_kernels.dot(a + p0, b + p0, pEnd - p0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void gemm_nn(int M, int N, int K, float alpha, const float* A, int lda,
+    const float* B, int ldb, float beta, float* C, int ldc)
+{
+    scale_matrix(M, N, beta, C, ldc);
+
+    for (int p0 = 0; p0 < K; p0 += GEMM_BLOCK_K)
+    {
+        int pEnd = min_int(p0 + GEMM_BLOCK_K, K);
+        for (int j0 = 0; j0 < N; j0 += GEMM_BLOCK_N)
+        {
+            int jEnd = min_int(j0 + GEMM_BLOCK_N, N);
+            for (int i0 = 0; i0 < M; i0 += GEMM_BLOCK_M)
+            {
+                int iEnd = min_int(i0 + GEMM_BLOCK_M, M);
+                for (int i = i0; i < iEnd; i++)
+                {
+                    float* c = C + (size_t)i * ldc;
+                    for (int p = p0; p < pEnd; p++)
+                    {
+                        float a = alpha * A[(size_t)i * lda + p];
+                        g_kernels.axpy(a, B + (size_t)p * ldb + j0, c + j0, jEnd - j0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void gemm_tn(int M, int N, int K, float alpha, const float* A, int lda,
+    const float* B, int ldb, float beta, float* C, int ldc)
+{
+    scale_matrix(M, N, beta, C, ldc);
+
+    for (int p0 = 0; p0 < K; p0 += GEMM_BLOCK_K)
+    {
+        int pEnd = min_int(p0 + GEMM_BLOCK_K, K);
+        for (int j0 = 0; j0 < N; j0 += GEMM_BLOCK_N)
+        {
+            int jEnd = min_int(j0 + GEMM_BLOCK_N, N);
+            for (int i0 = 0; i0 < M; i0 += GEMM_BLOCK_M)
+            {
+                int iEnd = min_int(i0 + GEMM_BLOCK_M, M);
+                for (int p = p0; p < pEnd; p++)
+                {
+                    const float* a = A + (size_t)p * lda;
+                    const float* b = B + (size_t)p * ldb;
+                    for (int i = i0; i < iEnd; i++)
+                        g_kernels.axpy(alpha * a[i], b + j0, C + (size_t)i * ldc + j0, jEnd - j0);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// Cache blocking sizes (in floats). A BLOCK_M x BLOCK_K tile of A and a
+// BLOCK_N x BLOCK_K tile of B fit together in L2 so every weight tile is
+// reused for the whole mini-batch before it is evicted.
+#define GEMM_BLOCK_M 64
+#define GEMM_BLOCK_N 64
+#define GEMM_BLOCK_K 256
+
+// All matrices are row-major. ld* is the row stride of each matrix.
+
+// C = alpha * A * B^T + beta * C    A: M x K, B: N x K, C: M x N
+void gemm_nt(int M, int N, int K, float alpha, const float* A, int lda,
+    const float* B, int ldb, float beta, float* C, int ldc);
+
+// C = alpha * A * B + beta * C      A: M x K, B: K x N, C: M x N
+void gemm_nn(int M, int N, int K, float alpha, const float* A, int lda,
+    const float* B, int ldb, float beta, float* C, int ldc);
+
+// C = alpha * A^T * B + beta * C    A: K x M, B: K x N, C: M x N
+void gemm_tn(int M, int N, int K, float alpha, const float* A, int lda,
+    const float* B, int ldb, float beta, float* C, int ldc);
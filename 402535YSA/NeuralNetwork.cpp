@@ -1,519 +1,1235 @@
 ﻿#include "pch.h"
 #include "NeuralNetwork.h"
 #include "Process.h"
+#include "MatrixOps.h"
+#include "Kernels.h"
+#include "ThreadPool.h"
+#include "Optimizer.h"
+#include "WeightFile.h"
+#include "Normalization.h"
+#include "HalfPrecisionModel.h"
+#include "TrainingJob.h"
 #include <math.h>
 #include <cfloat>
 #include <fstream>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+// Everything below is compiled as native code even though the project
+// builds with /clr; the weight file dialogs live in Form1.
+#pragma managed(push, off)
+
+static inline long long elapsedNanos(double since)
+{
+    return (long long)((MonotonicSeconds() - since) * 1e9);
+}
 
 void NeuralModel::InitializeModel(const int hiddenLayerCount, int* unitCounts, const int inputDimension, const int outputClassCount)
 {
-    this->layers = new LayerUnit[hiddenLayerCount + 1]; // hidden layers + output layer
+    layoutModel(hiddenLayerCount, unitCounts, inputDimension, outputClassCount);
+
+    this->parameters = alloc_aligned(this->parameterCount);
+    for (size_t k = 0; k < this->parameterCount; k++)
+        this->parameters[k] = 0;
 
-    for (int i = 0; i < hiddenLayerCount; i++)
+    // Same random sequence as before: W0, b0, W1, b1, ...
+    for (int l = 0; l < LayerCount(); l++)
     {
-        this->layers[i].units = new ProcessingUnit[unitCounts[i]];
-        this->layers[i].unitCount = unitCounts[i];
+        fill_array_random(weights(l), FanIn(l) * this->unitCounts[l]);
+        fill_array_random(offsets(l), this->unitCounts[l]);
     }
+}
 
-    this->layers[hiddenLayerCount].units = new ProcessingUnit[outputClassCount];
-    this->layers[hiddenLayerCount].unitCount = outputClassCount;
-
-    this->weightMatrix = new float* [hiddenLayerCount + 1];
-    this->offsetValues = new float* [hiddenLayerCount + 1];
+void NeuralModel::layoutModel(const int hiddenLayerCount, const int* unitCounts, const int inputDimension, const int outputClassCount)
+{
+    releaseModel();
 
-    // input -> first hidden layer
-    this->weightMatrix[0] = init_array_random(inputDimension * unitCounts[0]);
-    this->offsetValues[0] = init_array_random(unitCounts[0]);
+    this->hiddenLayerTotal = hiddenLayerCount;
+    this->inputDimension = inputDimension;
+    this->classCount = outputClassCount;
 
-    // hidden layers
-    for (int i = 0; i < hiddenLayerCount - 1; i++)
+    int layerTotal = hiddenLayerCount + 1; // hidden layers + output layer
+    this->unitCounts = new int[layerTotal];
+    this->unitOffset = new int[layerTotal];
+    this->weightOffset = new size_t[layerTotal];
+    this->biasOffset = new size_t[layerTotal];
+
+    for (int l = 0; l < hiddenLayerCount; l++)
+        this->unitCounts[l] = unitCounts[l];
+    this->unitCounts[hiddenLayerCount] = outputClassCount;
+
+    // Parameter arena: W0 b0 W1 b1 ... with every section starting on a
+    // 64 byte boundary
+    size_t cursor = 0;
+    int units = 0;
+    for (int l = 0; l < layerTotal; l++)
     {
-        this->weightMatrix[i + 1] = init_array_random(unitCounts[i] * unitCounts[i + 1]);
-        this->offsetValues[i + 1] = init_array_random(unitCounts[i + 1]);
+        this->weightOffset[l] = cursor;
+        cursor += align_floats((size_t)FanIn(l) * this->unitCounts[l]);
+        this->biasOffset[l] = cursor;
+        cursor += align_floats(this->unitCounts[l]);
+
+        this->unitOffset[l] = units;
+        units += this->unitCounts[l];
     }
+    this->parameterCount = cursor;
 
-    // last hidden layer -> output layer
-    this->weightMatrix[hiddenLayerCount] = init_array_random(unitCounts[hiddenLayerCount - 1] * outputClassCount);
-    this->offsetValues[hiddenLayerCount] = init_array_random(outputClassCount);
+    // Training scratch lives in the TrainingWorkspaces of Train()
+    this->totalUnits = units;
+}
 
-    this->hiddenLayerTotal = hiddenLayerCount;
-    this->inputDimension = inputDimension;
-    this->classCount = outputClassCount;
+void NeuralModel::SetInputNormalization(const float* mean, const float* variance)
+{
+    // The parameters stay folded for raw features; Train unfolds them with
+    // whatever statistics are stored when it starts
+    if (inputMean == nullptr)
+    {
+        inputMean = new float[this->inputDimension];
+        inputScale = new float[this->inputDimension];
+    }
+    memcpy(inputMean, mean, this->inputDimension * sizeof(float));
+    InverseStdDev(variance, inputScale, this->inputDimension);
 }
 
-int NeuralModel::performSGDTraining(float* trainingData, float* targetData, int sampleCount)
+void NeuralModel::AttachInputNormalization(const float* mean, const float* variance)
 {
-    float targetVal, cumulativeError = 0, rmseError = 0;
-    this->errorHistory = new double[CYCLE_MAX];
+    SetInputNormalization(mean, variance);
+    foldInputNormalization(true);
+}
 
-    float** layerSignals = new float* [this->hiddenLayerTotal + 1];
+void NeuralModel::foldInputNormalization(bool fold)
+{
+    int fanIn = this->inputDimension;
+    for (int j = 0; j < unitCounts[0]; j++)
+    {
+        float* w = weights(0) + j * fanIn;
+        if (fold)
+            for (int d = 0; d < fanIn; d++)
+                w[d] *= inputScale[d];
+
+        double shift = 0;
+        for (int d = 0; d < fanIn; d++)
+            shift += (double)w[d] * inputMean[d];
+        offsets(0)[j] += (float)(fold ? -shift : shift);
+
+        if (!fold)
+            for (int d = 0; d < fanIn; d++)
+                w[d] /= inputScale[d];
+    }
+}
 
-    for (int l = 0; l < this->hiddenLayerTotal + 1; l++)
-        layerSignals[l] = new float[layers[l].unitCount];
+const float* NeuralModel::normalizeBatch(const float* input, int rows, TrainingWorkspace& ws) const
+{
+    if (inputMean == nullptr)
+        return input;
+    int dim = this->inputDimension;
+    for (int r = 0; r < rows; r++)
+        for (int d = 0; d < dim; d++)
+            ws.inputs[r * dim + d] = (input[r * dim + d] - inputMean[d]) * inputScale[d];
+    return ws.inputs;
+}
 
-    for (int iteration = 0; iteration < CYCLE_MAX; iteration++)
+void NeuralModel::forwardBatch(const float* input, int rows, TrainingWorkspace& ws) const
+{
+    for (int l = 0; l < this->hiddenLayerTotal + 1; l++)
     {
-        cumulativeError = 0;
+        double start = ws.timing ? MonotonicSeconds() : 0;
+        int fanIn = FanIn(l);
+        int unitCount = unitCounts[l];
+        const float* prev = (l == 0) ? input : layerActivations(ws, l - 1);
+        float* out = layerActivations(ws, l);
+
+        // Z = X * W^T + b, A = tanh(Z)
+        for (int r = 0; r < rows; r++)
+            for (int j = 0; j < unitCount; j++)
+                out[r * unitCount + j] = offsets(l)[j];
+
+        gemm_nt(rows, unitCount, fanIn, 1.0f, prev, fanIn, weights(l), fanIn, 1.0f, out, unitCount);
+
+        g_kernels.tanh(out, rows * unitCount);
+        if (ws.timing)
+            ws.layerNanos[l] += elapsedNanos(start);
+    }
+}
 
-        for (int s = 0; s < sampleCount; s++)
+float NeuralModel::backwardBatch(const float* input, const int* targetLabels, int rows, float scale, TrainingWorkspace& ws, float* gradient) const
+{
+    float targetVal, cumulativeError = 0;
+    int outLayer = this->hiddenLayerTotal;
+    long long* backwardNanos = ws.layerNanos + ws.layerCount;
+    double start = ws.timing ? MonotonicSeconds() : 0;
+
+    // Output layer: dE/dZ for E = 1/2 * sum (t - a)^2
+    float* outAct = layerActivations(ws, outLayer);
+    float* outSignal = layerSignals(ws, outLayer);
+    for (int r = 0; r < rows; r++)
+    {
+        for (int j = 0; j < this->classCount; j++)
         {
-            // Forward: Input Layer
-            for (int j = 0; j < layers[0].unitCount; j++)
-                layers[0].units[j].summedInput = 0;
+            if (j == targetLabels[r])
+                targetVal = +1;
+            else
+                targetVal = -1;
+
+            float a = outAct[r * this->classCount + j];
+            float diff = a - targetVal;
+            outSignal[r * this->classCount + j] = diff * (1 - a * a);
+            cumulativeError += diff * diff;
+        }
+    }
 
-            for (int j = 0; j < layers[0].unitCount; j++)
-            {
-                for (int i = 0; i < this->inputDimension; i++)
-                {
-                    layers[0].units[j].summedInput += trainingData[(s * this->inputDimension) + i] *
-                        this->weightMatrix[0][(j * this->inputDimension) + i];
-                }
-                layers[0].units[j].summedInput += offsetValues[0][j];
-                layers[0].units[j].activation = (float)tanh(layers[0].units[j].summedInput);
-            }
+    if (ws.timing)
+    {
+        backwardNanos[outLayer] += elapsedNanos(start);
+        start = MonotonicSeconds();
+    }
 
-            // Forward: Hidden + Output
-            for (int l = 1; l < this->hiddenLayerTotal + 1; l++)
-            {
-                for (int j = 0; j < layers[l].unitCount; j++)
-                    layers[l].units[j].summedInput = 0;
-
-                for (int j = 0; j < layers[l].unitCount; j++)
-                {
-                    for (int i = 0; i < layers[l - 1].unitCount; i++)
-                        layers[l].units[j].summedInput += layers[l - 1].units[i].activation *
-                        this->weightMatrix[l][j * (layers[l - 1].unitCount) + i];
-
-                    layers[l].units[j].summedInput += offsetValues[l][j];
-                    layers[l].units[j].activation = (float)tanh(layers[l].units[j].summedInput);
-
-                    // Output layer
-                    if (l == hiddenLayerTotal)
-                    {
-                        if (j == (int)targetData[s])
-                            targetVal = +1;
-                        else
-                            targetVal = -1;
-
-                        float deriv = 1 - pow(layers[l].units[j].activation, 2);
-                        layerSignals[l][j] = (targetVal - layers[l].units[j].activation) * deriv;
-
-                        for (int i = 0; i < layers[l - 1].unitCount; i++)
-                            this->weightMatrix[l][j * (layers[l - 1].unitCount) + i] +=
-                            LEARNING_RATE * layerSignals[l][j] * layers[l - 1].units[i].activation;
-
-                        this->offsetValues[l][j] += LEARNING_RATE * layerSignals[l][j];
-                        cumulativeError += pow((targetVal - layers[l].units[j].activation), 2);
-                    }
-                }
-            }
+    // Backprop: S_prev = (S * W) .* (1 - A_prev^2), timed with layer l
+    for (int l = outLayer; l > 0; l--)
+    {
+        int unitCount = unitCounts[l];
+        int prevCount = unitCounts[l - 1];
+        gemm_nn(rows, prevCount, unitCount, 1.0f, layerSignals(ws, l), unitCount,
+            weights(l), prevCount, 0.0f, layerSignals(ws, l - 1), prevCount);
 
-            // Backprop: Hidden Layers
-            for (int l = this->hiddenLayerTotal - 1; l > 0; l--)
-            {
-                for (int j = 0; j < layers[l].unitCount; j++)
-                {
-                    float f_deriv = 1 - pow(layers[l].units[j].activation, 2);
-                    float sumVal = 0;
-                    for (int k = 0; k < layers[l + 1].unitCount; k++)
-                        sumVal += layerSignals[l + 1][k] * this->weightMatrix[l + 1][k * layers[l].unitCount + j];
-
-                    layerSignals[l][j] = f_deriv * sumVal;
-                    for (int i = 0; i < layers[l - 1].unitCount; i++)
-                        this->weightMatrix[l][j * layers[l - 1].unitCount + i] +=
-                        LEARNING_RATE * layerSignals[l][j] * layers[l - 1].units[i].activation;
-
-                    this->offsetValues[l][j] += LEARNING_RATE * layerSignals[l][j];
-                }
-            }
+        g_kernels.tanhGrad(layerActivations(ws, l - 1), layerSignals(ws, l - 1), rows * prevCount);
+        if (ws.timing)
+        {
+            backwardNanos[l] += elapsedNanos(start);
+            start = MonotonicSeconds();
+        }
+    }
 
-            // Backprop: Input Layer
-            for (int j = 0; j < layers[0].unitCount; j++)
-            {
-                float f_deriv = 1 - pow(layers[0].units[j].activation, 2);
-                float sumVal = 0;
-                for (int k = 0; k < layers[1].unitCount; k++)
-                    sumVal += layerSignals[1][k] * this->weightMatrix[1][k * layers[0].unitCount + j];
+    // dW = scale * S^T * X, db = scale * sum(S)
+    for (int l = 0; l < this->hiddenLayerTotal + 1; l++)
+    {
+        if (ws.timing)
+            start = MonotonicSeconds();
+        int fanIn = FanIn(l);
+        int unitCount = unitCounts[l];
+        const float* prev = (l == 0) ? input : layerActivations(ws, l - 1);
+        float* sig = layerSignals(ws, l);
+
+        gemm_tn(unitCount, fanIn, rows, scale, sig, unitCount, prev, fanIn,
+            0.0f, gradient + weightOffset[l], fanIn);
+
+        float* offsetGradient = gradient + biasOffset[l];
+        for (int j = 0; j < unitCount; j++)
+        {
+            float sumVal = 0;
+            for (int r = 0; r < rows; r++)
+                sumVal += sig[r * unitCount + j];
+            offsetGradient[j] = scale * sumVal;
+        }
+        if (ws.timing)
+            backwardNanos[l] += elapsedNanos(start);
+    }
+    return cumulativeError;
+}
 
-                layerSignals[0][j] = f_deriv * sumVal;
-                for (int i = 0; i < this->inputDimension; i++)
-                    this->weightMatrix[0][j * this->inputDimension + i] +=
-                    LEARNING_RATE * layerSignals[0][j] * trainingData[(s * this->inputDimension) + i];
+void NeuralModel::stepParameters(Optimizer& optimizer, const float* gradient, TrainingWorkspace& ws)
+{
+    float* target = (masterParameters != nullptr) ? masterParameters : this->parameters;
+    if (!ws.timing)
+    {
+        optimizer.Step(target, gradient);
+        if (masterParameters != nullptr)
+            RoundToPrecision(masterParameters, this->parameters, this->parameterCount, trainingPrecision);
+        return;
+    }
+    long long* updateNanos = ws.layerNanos + 2 * ws.layerCount;
+    optimizer.BeginStep();
+    for (int l = 0; l < this->hiddenLayerTotal + 1; l++)
+    {
+        // Layer l owns its padding up to the next layer's weights
+        size_t end = (l < this->hiddenLayerTotal) ? weightOffset[l + 1] : this->parameterCount;
+        double start = MonotonicSeconds();
+        optimizer.Update(target, gradient, weightOffset[l], end);
+        if (masterParameters != nullptr)
+            RoundToPrecision(masterParameters + weightOffset[l], this->parameters + weightOffset[l],
+                end - weightOffset[l], trainingPrecision);
+        updateNanos[l] += elapsedNanos(start);
+    }
+}
+
+float NeuralModel::trainEpochSync(const float* trainingData, const int* targetLabels, int sampleCount, int batchSize,
+    Optimizer& optimizer, ThreadPool& pool, TrainingWorkspace* workspaces, float* shardGradients, float* gradient)
+{
+    int workers = pool.ThreadCount();
+    float* shardErrors = new float[workers];
+    float cumulativeError = 0;
 
-                offsetValues[0][j] += LEARNING_RATE * layerSignals[0][j];
+    for (int start = 0; start < sampleCount; start += batchSize)
+    {
+        int rows = (sampleCount - start < batchSize) ? sampleCount - start : batchSize;
+        int shardRows = (rows + workers - 1) / workers;
+        int shards = (rows + shardRows - 1) / shardRows;
+        float scale = 1.0f / rows;
+
+        // Shard s always covers the same rows and writes its own buffer
+        pool.ParallelFor(shards, 1, [&](int begin, int end, int worker) {
+            for (int s = begin; s < end; s++)
+            {
+                int first = start + s * shardRows;
+                int count = (first + shardRows <= start + rows) ? shardRows : start + rows - first;
+                const float* shardInput = normalizeBatch(trainingData + (size_t)first * this->inputDimension, count, workspaces[worker]);
+                float* shardGradient = (shards == 1) ? gradient : shardGradients + (size_t)s * this->parameterCount;
+                forwardBatch(shardInput, count, workspaces[worker]);
+                shardErrors[s] = backwardBatch(shardInput, targetLabels + first, count, scale, workspaces[worker], shardGradient);
             }
-        }
+        });
 
-        rmseError = sqrt(cumulativeError / (sampleCount * this->classCount));
-        this->errorHistory[iteration] = (double)rmseError;
-        if (rmseError < EMAX)
+        // Sum the shards in order, each worker owning a slice of the arena
+        if (shards > 1)
         {
-            for (int l = 0; l < this->hiddenLayerTotal + 1; l++)
-                delete[] layerSignals[l];
-            delete[] layerSignals;
-            return iteration;
+            pool.ParallelFor((int)this->parameterCount, PARALLEL_GRAIN * 16, [&](int begin, int end, int) {
+                memcpy(gradient + begin, shardGradients + begin, (end - begin) * sizeof(float));
+                for (int s = 1; s < shards; s++)
+                    g_kernels.axpy(1.0f, shardGradients + (size_t)s * this->parameterCount + begin, gradient + begin, end - begin);
+            });
         }
+        for (int s = 0; s < shards; s++)
+            cumulativeError += shardErrors[s];
+
+        stepParameters(optimizer, gradient, workspaces[0]);
     }
 
-    for (int l = 0; l < this->hiddenLayerTotal + 1; l++)
-        delete[] layerSignals[l];
-    delete[] layerSignals;
-    return 0;
+    delete[] shardErrors;
+    return cumulativeError;
 }
 
-
-int NeuralModel::performSGDTrainingWithMomentum(float* trainingData, float* targetData, int sampleCount)
+float NeuralModel::trainEpochHogwild(const float* trainingData, const int* targetLabels, int sampleCount, int batchSize,
+    Optimizer& optimizer, ThreadPool& pool, TrainingWorkspace* workspaces, float* workerGradients)
 {
-    float targetVal, cumulativeError = 0, rmseError = 0, mseError = 0;
-    this->errorHistory = new double[CYCLE_MAX];
+    int workers = pool.ThreadCount();
+    float* workerErrors = new float[workers];
+    for (int w = 0; w < workers; w++)
+        workerErrors[w] = 0;
+
+    // Reads of the parameters race with other workers' steps; each worker's
+    // gradient may be computed from a mix of old and new weights.
+    int batchCount = (sampleCount + batchSize - 1) / batchSize;
+    pool.ParallelFor(batchCount, 1, [&](int begin, int end, int worker) {
+        float* gradient = workerGradients + (size_t)worker * this->parameterCount;
+        for (int b = begin; b < end; b++)
+        {
+            int start = b * batchSize;
+            int rows = (sampleCount - start < batchSize) ? sampleCount - start : batchSize;
+            const float* batchInput = normalizeBatch(trainingData + (size_t)start * this->inputDimension, rows, workspaces[worker]);
+            forwardBatch(batchInput, rows, workspaces[worker]);
+            workerErrors[worker] += backwardBatch(batchInput, targetLabels + start, rows, 1.0f / rows, workspaces[worker], gradient);
+            stepParameters(optimizer, gradient, workspaces[worker]);
+        }
+    });
 
-    float** layerSignals = new float* [this->hiddenLayerTotal + 1];
-    float*** momentumMatrix = new float** [this->hiddenLayerTotal + 1];
-    float*** momentOffset = new float** [this->hiddenLayerTotal + 1];
+    float cumulativeError = 0;
+    for (int w = 0; w < workers; w++)
+        cumulativeError += workerErrors[w];
+    delete[] workerErrors;
+    return cumulativeError;
+}
 
-    for (int l = 0; l < this->hiddenLayerTotal + 1; l++)
-        layerSignals[l] = new float[layers[l].unitCount];
+float NeuralModel::trainEpochSerial(const float* trainingData, const int* targetLabels, int sampleCount, int batchSize,
+    Optimizer& optimizer, TrainingWorkspace& ws, float* gradient)
+{
+    float cumulativeError = 0;
+    for (int start = 0; start < sampleCount; start += batchSize)
+    {
+        int rows = (sampleCount - start < batchSize) ? sampleCount - start : batchSize;
+        const float* batchInput = normalizeBatch(trainingData + (size_t)start * this->inputDimension, rows, ws);
 
-    int inputSize = this->inputDimension * layers[0].unitCount;
-    momentumMatrix[0] = new float* [inputSize];
-    for (int i = 0; i < inputSize; i++)
-        momentumMatrix[0][i] = init_array_zero(T_SIZE);
+        forwardBatch(batchInput, rows, ws);
+        cumulativeError += backwardBatch(batchInput, targetLabels + start, rows, 1.0f / rows, ws, gradient);
+        stepParameters(optimizer, gradient, ws);
+    }
+    return cumulativeError;
+}
 
-    for (int l = 1; l < this->hiddenLayerTotal + 1; l++)
+float NeuralModel::evaluateError(const float* data, const int* targetLabels, int count, TrainingWorkspace& ws) const
+{
+    float cumulativeError = 0;
+    float* outAct = layerActivations(ws, this->hiddenLayerTotal);
+    for (int start = 0; start < count; start += ws.Rows())
     {
-        int size = layers[l - 1].unitCount * layers[l].unitCount;
-        momentumMatrix[l] = new float* [size];
-        for (int i = 0; i < size; i++)
-            momentumMatrix[l][i] = init_array_zero(T_SIZE);
+        int rows = (count - start < ws.Rows()) ? count - start : ws.Rows();
+        forwardBatch(normalizeBatch(data + (size_t)start * this->inputDimension, rows, ws), rows, ws);
+        for (int r = 0; r < rows; r++)
+        {
+            for (int j = 0; j < this->classCount; j++)
+            {
+                float targetVal = (j == targetLabels[start + r]) ? 1.0f : -1.0f;
+                float diff = outAct[r * this->classCount + j] - targetVal;
+                cumulativeError += diff * diff;
+            }
+        }
     }
+    return cumulativeError;
+}
 
-    for (int l = 0; l < this->hiddenLayerTotal + 1; l++)
+// Small xorshift generator so the validation split does not consume rand()
+static unsigned int nextShuffleState(unsigned int* state)
+{
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// Result of a Train call that had no training rows: no epoch ran
+static TrainingResult untrainedResult()
+{
+    TrainingResult result;
+    result.reason = STOP_MAX_EPOCHS;
+    result.lastEpoch = -1;
+    result.bestEpoch = -1;
+    result.trainError = 0;
+    result.validationError = -1;
+    result.bestError = 0;
+    return result;
+}
+
+TrainingResult NeuralModel::Train(const float* trainingData, const int* targetLabels, int sampleCount, Optimizer& optimizer,
+    const TrainingConfig& config)
+{
+    // The validation split always leaves at least one training row, so
+    // only an empty sample set has none; the model stays as it is
+    if (sampleCount < 1 || this->parameters == nullptr)
+        return untrainedResult();
+    int maxEpochs = (config.maxEpochs > 0) ? config.maxEpochs : 1;
+    this->errorHistory.Clear();
+
+    // The parameters train on normalized batches and are folded back at the end
+    bool normalized = HasInputNormalization();
+    if (normalized)
+        foldInputNormalization(false);
+
+    // Mixed precision: the optimizer steps an fp32 master copy and the
+    // forward / backward passes see it rounded to trainingPrecision
+    trainingPrecision = config.weightPrecision;
+    if (trainingPrecision != PRECISION_FP32)
     {
-        int size = layers[l].unitCount;
-        momentOffset[l] = new float* [size];
-        for (int i = 0; i < size; i++)
-            momentOffset[l][i] = init_array_zero(T_SIZE);
+        masterParameters = alloc_aligned(this->parameterCount);
+        memcpy(masterParameters, this->parameters, this->parameterCount * sizeof(float));
+        RoundToPrecision(masterParameters, this->parameters, this->parameterCount, trainingPrecision);
     }
 
-    for (int iteration = 0; iteration < CYCLE_MAX; iteration++)
+    // Held-out split: a shuffled copy, training rows first
+    const float* trainData = trainingData;
+    const int* trainLabels = targetLabels;
+    int trainCount = sampleCount;
+    int validationCount = 0;
+    float* splitData = nullptr;
+    int* splitLabels = nullptr;
+    if (config.validationData == nullptr && config.validationFraction > 0 && sampleCount > 1)
     {
-        cumulativeError = 0;
-
-        for (int s = 0; s < sampleCount; s++)
+        validationCount = (int)(config.validationFraction * sampleCount);
+        if (validationCount < 1)
+            validationCount = 1;
+        if (validationCount > sampleCount - 1)
+            validationCount = sampleCount - 1;
+        trainCount = sampleCount - validationCount;
+
+        int* order = new int[sampleCount];
+        for (int i = 0; i < sampleCount; i++)
+            order[i] = i;
+        unsigned int state = config.shuffleSeed ? config.shuffleSeed : 1;
+        for (int i = sampleCount - 1; i > 0; i--)
         {
-            // Forward: Input Layer
-            for (int j = 0; j < layers[0].unitCount; j++)
-                layers[0].units[j].summedInput = 0;
+            int k = (int)(nextShuffleState(&state) % (unsigned int)(i + 1));
+            int tmp = order[i];
+            order[i] = order[k];
+            order[k] = tmp;
+        }
 
-            for (int j = 0; j < layers[0].unitCount; j++)
-            {
-                for (int i = 0; i < this->inputDimension; i++)
-                {
-                    layers[0].units[j].summedInput += trainingData[(s * this->inputDimension) + i] *
-                        this->weightMatrix[0][(j * this->inputDimension) + i];
-                }
-                layers[0].units[j].summedInput += offsetValues[0][j];
-                layers[0].units[j].activation = (float)tanh(layers[0].units[j].summedInput);
-            }
+        splitData = new float[(size_t)sampleCount * this->inputDimension];
+        splitLabels = new int[sampleCount];
+        for (int i = 0; i < sampleCount; i++)
+        {
+            memcpy(splitData + (size_t)i * this->inputDimension, trainingData + (size_t)order[i] * this->inputDimension,
+                this->inputDimension * sizeof(float));
+            splitLabels[i] = targetLabels[order[i]];
+        }
+        delete[] order;
+        trainData = splitData;
+        trainLabels = splitLabels;
+    }
+    const float* validationData = trainData + (size_t)trainCount * this->inputDimension;
+    const int* validationLabels = trainLabels + trainCount;
+    if (config.validationData != nullptr && config.validationCount > 0)
+    {
+        validationData = config.validationData;
+        validationLabels = config.validationLabels;
+        validationCount = config.validationCount;
+    }
 
-            // Forward: Hidden + Output
-            for (int l = 1; l < this->hiddenLayerTotal + 1; l++)
-            {
-                for (int j = 0; j < layers[l].unitCount; j++)
-                    layers[l].units[j].summedInput = 0;
-
-                for (int j = 0; j < layers[l].unitCount; j++)
-                {
-                    for (int i = 0; i < layers[l - 1].unitCount; i++)
-                    {
-                        layers[l].units[j].summedInput += layers[l - 1].units[i].activation *
-                            this->weightMatrix[l][j * (layers[l - 1].unitCount) + i];
-                    }
-                    layers[l].units[j].summedInput += offsetValues[l][j];
-                    layers[l].units[j].activation = (float)tanh(layers[l].units[j].summedInput);
-
-                    if (l == this->hiddenLayerTotal) // output layer
-                    {
-                        if ((int)targetData[s] == j)
-                            targetVal = +1;
-                        else
-                            targetVal = -1;
-
-                        float f_deriv = 1 - pow(layers[l].units[j].activation, 2);
-                        layerSignals[l][j] = (targetVal - layers[l].units[j].activation) * f_deriv;
-                        for (int i = 0; i < layers[l - 1].unitCount; i++)
-                        {
-                            int w_index = j * (layers[l - 1].unitCount) + i;
-                            float delta_w = LEARNING_RATE * layerSignals[l][j] * layers[l - 1].units[i].activation;
-                            float MOMENT_SUM = 0;
-                            for (int t = 0; t < T_SIZE - 1; t++)
-                                MOMENT_SUM += MOMENT_RATE * momentumMatrix[l][w_index][t];
-
-                            this->weightMatrix[l][w_index] += delta_w + MOMENT_SUM;
-                            push_back(momentumMatrix, l, w_index, T_SIZE, delta_w);
-                        }
-                        float delta_b = LEARNING_RATE * layerSignals[l][j];
-                        float MOMENT_B = 0;
-                        for (int t = 0; t < T_SIZE - 1; t++)
-                            MOMENT_B += MOMENT_RATE * momentOffset[l][j][t];
-                        this->offsetValues[l][j] += delta_b + MOMENT_B;
-                        push_back(momentOffset, l, j, T_SIZE, delta_b);
-
-                        cumulativeError += pow((targetVal - layers[l].units[j].activation), 2);
-                    }
-                }
-            }
+    int batchSize = config.batchSize;
+    if (batchSize < 1)
+        batchSize = 1;
+    if (batchSize > trainCount)
+        batchSize = trainCount;
+
+    TrainingParallelism parallelism = config.parallelism;
+    ThreadPool& workerPool = (config.pool != nullptr) ? *config.pool : DefaultThreadPool();
+    int workers = (parallelism == TRAIN_SERIAL) ? 1 : workerPool.ThreadCount();
+    int workspaceRows = (parallelism == TRAIN_SYNC) ? (batchSize + workers - 1) / workers : batchSize;
+    if (validationCount > 0 && workspaceRows < BATCH_SIZE)
+        workspaceRows = BATCH_SIZE; // validation passes use workspace 0 in blocks
+
+    TrainingWorkspace* workspaces = new TrainingWorkspace[workers];
+    for (int w = 0; w < workers; w++)
+    {
+        workspaces[w].Reserve(*this, workspaceRows);
+        workspaces[w].timing = config.telemetry != nullptr && config.timeLayers;
+    }
 
-            // Backprop: Hidden Layers
-            for (int l = this->hiddenLayerTotal - 1; l > 0; l--)
+    // Same layout as the parameter arena; padding stays zero. Parallel
+    // modes keep one more gradient per shard (sync) or worker (Hogwild).
+    float* gradient = alloc_aligned(this->parameterCount);
+    memset(gradient, 0, this->parameterCount * sizeof(float));
+    float* workerGradients = nullptr;
+    if (parallelism != TRAIN_SERIAL)
+    {
+        workerGradients = alloc_aligned(this->parameterCount * workers);
+        memset(workerGradients, 0, this->parameterCount * workers * sizeof(float));
+    }
+    if (config.resetOptimizer || optimizer.ParameterCount() != this->parameterCount)
+        optimizer.Initialize(this->parameterCount);
+
+    // Parameters of the best epoch, only kept when something can stop
+    // training past it
+    float* bestParameters = nullptr;
+    if (config.restoreBest && (config.patience > 0 || validationCount > 0 || config.timeBudgetSeconds > 0
+        || config.cancel != nullptr))
+        bestParameters = alloc_aligned(this->parameterCount);
+
+    float baseRate = optimizer.learningRate;
+    float plateauRate = baseRate;
+    double startTime = MonotonicSeconds();
+    int sinceBest = 0, sincePlateau = 0;
+    int snapshotInterval = (config.snapshotInterval > 0) ? config.snapshotInterval : 1;
+
+    TrainingResult result;
+    result.reason = STOP_MAX_EPOCHS;
+    result.lastEpoch = 0;
+    result.bestEpoch = 0;
+    result.trainError = 0;
+    result.validationError = -1;
+    result.bestError = FLT_MAX;
+
+    // Telemetry: phase timers of all workers are summed and cleared at
+    // every report
+    int reportInterval = (config.reportInterval > 0) ? config.reportInterval : 1;
+    int layerTotal = this->hiddenLayerTotal + 1;
+    int lastReported = -1;
+    double lastReportTime = startTime;
+    long long* phaseNanos = new long long[3 * layerTotal];
+    auto report = [&](int iteration) {
+        for (int p = 0; p < 3 * layerTotal; p++)
+        {
+            phaseNanos[p] = 0;
+            for (int w = 0; w < workers; w++)
             {
-                for (int j = 0; j < layers[l].unitCount; j++)
-                {
-                    float f_deriv = 1 - pow(layers[l].units[j].activation, 2);
-                    float sumVal = 0;
-                    for (int k = 0; k < layers[l + 1].unitCount; k++)
-                        sumVal += layerSignals[l + 1][k] * this->weightMatrix[l + 1][k * layers[l].unitCount + j];
-
-                    layerSignals[l][j] = f_deriv * sumVal;
-
-                    for (int i = 0; i < layers[l - 1].unitCount; i++)
-                    {
-                        float delta_w = LEARNING_RATE * layerSignals[l][j] * layers[l - 1].units[i].activation;
-                        int w_index = j * layers[l - 1].unitCount + i;
-                        float MOMENT_SUM = 0;
-                        for (int t = 0; t < T_SIZE - 1; t++)
-                            MOMENT_SUM += MOMENT_RATE * momentumMatrix[l][w_index][t];
-                        this->weightMatrix[l][w_index] += delta_w + MOMENT_SUM;
-                        push_back(momentumMatrix, l, w_index, T_SIZE, delta_w);
-                    }
-                    float delta_b = LEARNING_RATE * layerSignals[l][j];
-                    float MOMENT_B = 0;
-                    for (int t = 0; t < T_SIZE - 1; t++)
-                        MOMENT_B += MOMENT_RATE * momentOffset[l][j][t];
-                    this->offsetValues[l][j] += delta_b + MOMENT_B;
-                    push_back(momentOffset, l, j, T_SIZE, delta_b);
-                }
+                phaseNanos[p] += workspaces[w].layerNanos[p];
+                workspaces[w].layerNanos[p] = 0;
             }
+        }
+        double now = MonotonicSeconds();
+        EpochTelemetry telemetry;
+        telemetry.epoch = iteration;
+        telemetry.trainError = result.trainError;
+        telemetry.validationError = result.validationError;
+        telemetry.learningRate = optimizer.learningRate;
+        telemetry.elapsedSeconds = now - startTime;
+        telemetry.samplesPerSecond = (now > lastReportTime)
+            ? (double)trainCount * (iteration - lastReported) / (now - lastReportTime) : 0;
+        telemetry.layerCount = layerTotal;
+        telemetry.forwardNanos = config.timeLayers ? phaseNanos : nullptr;
+        telemetry.backwardNanos = config.timeLayers ? phaseNanos + layerTotal : nullptr;
+        telemetry.updateNanos = config.timeLayers ? phaseNanos + 2 * layerTotal : nullptr;
+        config.telemetry->OnReport(telemetry);
+        lastReported = iteration;
+        lastReportTime = MonotonicSeconds(); // the receiver's time is not training time
+    };
+
+    for (int iteration = 0; iteration < maxEpochs; iteration++)
+    {
+        optimizer.learningRate = ScheduledLearningRate(config, baseRate, plateauRate, iteration);
+
+        float cumulativeError;
+        if (parallelism == TRAIN_HOGWILD)
+            cumulativeError = trainEpochHogwild(trainData, trainLabels, trainCount, batchSize,
+                optimizer, workerPool, workspaces, workerGradients);
+        else if (parallelism == TRAIN_SYNC)
+            cumulativeError = trainEpochSync(trainData, trainLabels, trainCount, batchSize,
+                optimizer, workerPool, workspaces, workerGradients, gradient);
+        else
+            cumulativeError = trainEpochSerial(trainData, trainLabels, trainCount, batchSize,
+                optimizer, workspaces[0], gradient);
+
+        float rmseError = sqrt(cumulativeError / (trainCount * this->classCount));
+        float monitored = rmseError;
+        this->errorHistory.Add(iteration, rmseError);
+        result.lastEpoch = iteration;
+        result.trainError = rmseError;
+        if (validationCount > 0)
+        {
+            float validationError = evaluateError(validationData, validationLabels, validationCount, workspaces[0]);
+            monitored = sqrt(validationError / (validationCount * this->classCount));
+            result.validationError = monitored;
+        }
+        if (config.telemetry != nullptr && (iteration + 1) % reportInterval == 0)
+            report(iteration);
+        if (config.snapshots != nullptr && (iteration == 0 || (iteration + 1) % snapshotInterval == 0))
+            publishSnapshot(*config.snapshots, iteration);
 
-            // Backprop: Input Layer
-            for (int j = 0; j < layers[0].unitCount; j++)
-            {
-                float f_deriv = 1 - pow(layers[0].units[j].activation, 2);
-                float sumVal = 0;
-                for (int k = 0; k < layers[1].unitCount; k++)
-                    sumVal += layerSignals[1][k] * this->weightMatrix[1][k * layers[0].unitCount + j];
-
-                layerSignals[0][j] = f_deriv * sumVal;
-                for (int i = 0; i < this->inputDimension; i++)
-                {
-                    float delta_w = LEARNING_RATE * layerSignals[0][j] * trainingData[(s * this->inputDimension) + i];
-                    int w_index = j * this->inputDimension + i;
-                    float MOMENT_SUM = 0;
-                    for (int t = 0; t < T_SIZE; t++)
-                        MOMENT_SUM += MOMENT_RATE * momentumMatrix[0][w_index][t];
-                    this->weightMatrix[0][w_index] += delta_w + MOMENT_SUM;
-                    push_back(momentumMatrix, 0, w_index, T_SIZE, delta_w);
-                }
-                float delta_b = LEARNING_RATE * layerSignals[0][j];
-                float MOMENT_B = 0;
-                for (int t = 0; t < T_SIZE - 1; t++)
-                    MOMENT_B += MOMENT_RATE * momentOffset[0][j][t];
-                this->offsetValues[0][j] += delta_b + MOMENT_B;
-                push_back(momentOffset, 0, j, T_SIZE, delta_b);
-            }
+        if (monitored < result.bestError - config.minImprovement)
+        {
+            result.bestError = monitored;
+            result.bestEpoch = iteration;
+            sinceBest = 0;
+            sincePlateau = 0;
+            if (bestParameters != nullptr)
+                memcpy(bestParameters, (masterParameters != nullptr) ? masterParameters : this->parameters,
+                    this->parameterCount * sizeof(float));
+        }
+        else
+        {
+            sinceBest++;
+            sincePlateau++;
         }
 
-        rmseError = sqrt(cumulativeError / (sampleCount * this->classCount));
-        this->errorHistory[iteration] = (double)rmseError;
-        if (rmseError < EMAX)
+        if (monitored < config.targetError)
         {
-            for (int l = 1; l < this->hiddenLayerTotal + 1; l++)
-            {
-                int size = layers[l - 1].unitCount * layers[l].unitCount;
-                for (int i = 0; i < size; i++)
-                    delete[] momentumMatrix[l][i];
-            }
-            for (int i = 0; i < inputSize; i++)
-                delete[] momentumMatrix[0][i];
-
-            for (int l = 0; l < this->hiddenLayerTotal + 1; l++) {
-                int size = layers[l].unitCount;
-                for (int i = 0; i < size; i++)
-                    delete[] momentOffset[l][i];
-                delete[] layerSignals[l];
-                delete[] momentumMatrix[l];
-                delete[] momentOffset[l];
-            }
-            delete[] momentOffset;
-            delete[] momentumMatrix;
-            delete[] layerSignals;
-            return iteration;
+            result.reason = STOP_TARGET_ERROR;
+            break;
+        }
+        if (config.schedule == LR_PLATEAU && sincePlateau >= config.plateauPatience)
+        {
+            plateauRate *= config.decay;
+            if (plateauRate < config.minLearningRate)
+                plateauRate = config.minLearningRate;
+            sincePlateau = 0;
+        }
+        if (config.patience > 0 && sinceBest >= config.patience)
+        {
+            result.reason = STOP_NO_IMPROVEMENT;
+            break;
+        }
+        if (config.timeBudgetSeconds > 0 && MonotonicSeconds() - startTime >= config.timeBudgetSeconds)
+        {
+            result.reason = STOP_TIME_BUDGET;
+            break;
+        }
+        if (config.cancel != nullptr && config.cancel->IsCancelled())
+        {
+            result.reason = STOP_CANCELLED;
+            break;
         }
     }
 
-    for (int l = 1; l < this->hiddenLayerTotal + 1; l++)
+    if (config.telemetry != nullptr && lastReported != result.lastEpoch)
+        report(result.lastEpoch);
+    delete[] phaseNanos;
+
+    if (masterParameters != nullptr)
     {
-        int size = layers[l - 1].unitCount * layers[l].unitCount;
-        for (int i = 0; i < size; i++)
-            delete[] momentumMatrix[l][i];
+        memcpy(this->parameters, masterParameters, this->parameterCount * sizeof(float));
+        free_aligned(masterParameters);
+        masterParameters = nullptr;
     }
-    for (int i = 0; i < inputSize; i++)
-        delete[] momentumMatrix[0][i];
+    if (bestParameters != nullptr && result.reason != STOP_TARGET_ERROR && result.bestEpoch != result.lastEpoch)
+        memcpy(this->parameters, bestParameters, this->parameterCount * sizeof(float));
+    if (normalized)
+        foldInputNormalization(true);
+    optimizer.learningRate = baseRate;
+    if (config.snapshots != nullptr)
+        config.snapshots->Publish(*this, result.lastEpoch);
+
+    free_aligned(bestParameters);
+    free_aligned(gradient);
+    free_aligned(workerGradients);
+    delete[] workspaces;
+    delete[] splitData;
+    delete[] splitLabels;
+    return result;
+}
 
-    for (int l = 0; l < this->hiddenLayerTotal + 1; l++)
+int NeuralModel::Train(const float* trainingData, const int* targetLabels, int sampleCount, Optimizer& optimizer, int batchSize,
+    TrainingParallelism parallelism, ThreadPool* pool)
+{
+    TrainingConfig config;
+    config.batchSize = batchSize;
+    config.parallelism = parallelism;
+    config.pool = pool;
+    TrainingResult result = Train(trainingData, targetLabels, sampleCount, optimizer, config);
+    return (result.reason == STOP_TARGET_ERROR) ? result.lastEpoch : 0;
+}
+
+TrainingResult NeuralModel::TrainIncremental(const float* trainingData, const int* targetLabels, int sampleCount, int firstNewSample,
+    Optimizer& optimizer, const IncrementalConfig& config)
+{
+    if (sampleCount < 1 || this->parameters == nullptr)
+        return untrainedResult();
+    if (firstNewSample <= 0 || firstNewSample >= sampleCount)
+        return Train(trainingData, targetLabels, sampleCount, optimizer, config);
+
+    int newCount = sampleCount - firstNewSample;
+    int weight = (config.newSampleWeight > 0) ? config.newSampleWeight : 1;
+    int replay = (config.replayCount < firstNewSample) ? config.replayCount : firstNewSample;
+    if (replay < 0)
+        replay = 0;
+    int rows = newCount * weight + replay;
+
+    // Row order: every new sample weight times, then the replayed old ones
+    // (partial Fisher-Yates over the old indices); shuffled together below
+    int* order = new int[rows];
+    int filled = 0;
+    for (int k = 0; k < weight; k++)
+        for (int i = firstNewSample; i < sampleCount; i++)
+            order[filled++] = i;
+
+    unsigned int state = config.shuffleSeed ? config.shuffleSeed : 1;
+    int* oldIndex = new int[firstNewSample];
+    for (int i = 0; i < firstNewSample; i++)
+        oldIndex[i] = i;
+    for (int i = 0; i < replay; i++)
+    {
+        int k = i + (int)(nextShuffleState(&state) % (unsigned int)(firstNewSample - i));
+        int tmp = oldIndex[i];
+        oldIndex[i] = oldIndex[k];
+        oldIndex[k] = tmp;
+        order[filled++] = oldIndex[i];
+    }
+    delete[] oldIndex;
+
+    for (int i = rows - 1; i > 0; i--)
     {
-        int size = layers[l].unitCount;
-        for (int i = 0; i < size; i++)
-            delete[] momentOffset[l][i];
-        delete[] layerSignals[l];
-        delete[] momentumMatrix[l];
-        delete[] momentOffset[l];
+        int k = (int)(nextShuffleState(&state) % (unsigned int)(i + 1));
+        int tmp = order[i];
+        order[i] = order[k];
+        order[k] = tmp;
     }
 
-    delete[] momentOffset;
-    delete[] momentumMatrix;
-    delete[] layerSignals;
-    return 0;
+    float* mixData = new float[(size_t)rows * this->inputDimension];
+    int* mixLabels = new int[rows];
+    for (int r = 0; r < rows; r++)
+    {
+        memcpy(mixData + (size_t)r * this->inputDimension, trainingData + (size_t)order[r] * this->inputDimension,
+            this->inputDimension * sizeof(float));
+        mixLabels[r] = targetLabels[order[r]];
+    }
+    delete[] order;
+
+    TrainingResult result = Train(mixData, mixLabels, rows, optimizer, config);
+    delete[] mixData;
+    delete[] mixLabels;
+    return result;
 }
 
-void NeuralModel::ExecuteTest(float* testData, int* predictedLabels, int dataCount)
+int NeuralModel::performSGDTraining(const float* trainingData, const int* targetLabels, int sampleCount)
 {
-    int maxIndex = 0;
-    for (int sample = 0; sample < dataCount; sample++)
+    SGDOptimizer optimizer((float)LEARNING_RATE);
+    return Train(trainingData, targetLabels, sampleCount, optimizer, 1);
+}
+
+int NeuralModel::performSGDTrainingWithMomentum(const float* trainingData, const int* targetLabels, int sampleCount)
+{
+    MomentumOptimizer optimizer((float)LEARNING_RATE, (float)MOMENT_RATE);
+    return Train(trainingData, targetLabels, sampleCount, optimizer, 1);
+}
+
+int NeuralModel::performMiniBatchTraining(const float* trainingData, const int* targetLabels, int sampleCount, int batchSize)
+{
+    SGDOptimizer optimizer((float)LEARNING_RATE);
+    return Train(trainingData, targetLabels, sampleCount, optimizer, batchSize);
+}
+
+int NeuralModel::classifySample(const float* input, float* const* layerActs) const
+{
+    const float* prev = input;
+    int fanIn = this->inputDimension;
+    for (int l = 0; l < this->hiddenLayerTotal + 1; l++)
     {
-        for (int j = 0; j < layers[0].unitCount; j++)
-            layers[0].units[j].summedInput = 0;
+        for (int j = 0; j < unitCounts[l]; j++)
+            layerActs[l][j] = g_kernels.dot(prev, weights(l) + j * fanIn, fanIn) + offsets(l)[j];
+        g_kernels.tanh(layerActs[l], unitCounts[l]);
+        prev = layerActs[l];
+        fanIn = unitCounts[l];
+    }
 
-        for (int j = 0; j < layers[0].unitCount; j++)
+    int maxIndex = 0;
+    float tempMax = -FLT_MAX;
+    float* output = layerActs[this->hiddenLayerTotal];
+    for (int j = 0; j < this->classCount; j++)
+    {
+        if (output[j] > tempMax)
         {
-            for (int i = 0; i < this->inputDimension; i++)
-            {
-                layers[0].units[j].summedInput += testData[(sample * this->inputDimension) + i] *
-                    this->weightMatrix[0][(j * this->inputDimension) + i];
-            }
-            layers[0].units[j].summedInput += offsetValues[0][j];
-            layers[0].units[j].activation = (float)tanh(layers[0].units[j].summedInput);
+            tempMax = output[j];
+            maxIndex = j;
         }
+    }
+    return maxIndex;
+}
 
-        for (int l = 1; l < this->hiddenLayerTotal + 1; l++)
-        {
-            for (int j = 0; j < layers[l].unitCount; j++)
-                layers[l].units[j].summedInput = 0;
+void NeuralModel::Predict(const float* testData, int* predictedLabels, int dataCount, InferenceWorkspace& workspace) const
+{
+    workspace.Reserve(*this);
+    for (int sample = 0; sample < dataCount; sample++)
+        predictedLabels[sample] = classifySample(testData + (sample * this->inputDimension), workspace.layerActs);
+}
 
-            for (int j = 0; j < layers[l].unitCount; j++)
-            {
-                for (int i = 0; i < layers[l - 1].unitCount; i++)
-                    layers[l].units[j].summedInput += layers[l - 1].units[i].activation *
-                    this->weightMatrix[l][j * (layers[l - 1].unitCount) + i];
+void NeuralModel::ExecuteTest(const float* testData, int* predictedLabels, int dataCount) const
+{
+    InferenceWorkspace workspace(*this);
+    Predict(testData, predictedLabels, dataCount, workspace);
+}
 
-                layers[l].units[j].summedInput += offsetValues[l][j];
-                layers[l].units[j].activation = (float)tanh(layers[l].units[j].summedInput);
-            }
-        }
+void NeuralModel::ExecuteTestParallel(const float* testData, int* predictedLabels, int dataCount) const
+{
+    ThreadPool& pool = DefaultThreadPool();
+    int workers = pool.ThreadCount();
 
-        float tempMax = -FLT_MAX;
-        int outLayerIndex = this->hiddenLayerTotal;
-        for (int j = 0; j < this->classCount; j++)
-        {
-            if (layers[outLayerIndex].units[j].activation > tempMax)
-            {
-                tempMax = layers[outLayerIndex].units[j].activation;
-                maxIndex = j;
-            }
-        }
-        predictedLabels[sample] = maxIndex;
+    InferenceWorkspace* workspaces = new InferenceWorkspace[workers];
+    for (int w = 0; w < workers; w++)
+        workspaces[w].Reserve(*this);
+
+    pool.ParallelFor(dataCount, PARALLEL_GRAIN, [&](int begin, int end, int worker) {
+        Predict(testData + (begin * this->inputDimension), predictedLabels + begin, end - begin, workspaces[worker]);
+    });
+
+    delete[] workspaces;
+}
+
+InferenceWorkspace::InferenceWorkspace()
+{
+    buffer = nullptr;
+    bufferSize = 0;
+    layerActs = nullptr;
+    layerCapacity = 0;
+}
+
+InferenceWorkspace::InferenceWorkspace(const NeuralModel& model)
+{
+    buffer = nullptr;
+    bufferSize = 0;
+    layerActs = nullptr;
+    layerCapacity = 0;
+    Reserve(model);
+}
+
+InferenceWorkspace::~InferenceWorkspace()
+{
+    delete[] buffer;
+    delete[] layerActs;
+}
+
+void InferenceWorkspace::Reserve(const NeuralModel& model)
+{
+    int layerTotal = model.LayerCount();
+    int totalUnits = 0;
+    for (int l = 0; l < layerTotal; l++)
+        totalUnits += model.UnitCount(l);
+
+    if (totalUnits > bufferSize)
+    {
+        delete[] buffer;
+        buffer = new float[totalUnits];
+        bufferSize = totalUnits;
+    }
+    if (layerTotal > layerCapacity)
+    {
+        delete[] layerActs;
+        layerActs = new float* [layerTotal];
+        layerCapacity = layerTotal;
+    }
+
+    float* block = buffer;
+    for (int l = 0; l < layerTotal; l++)
+    {
+        layerActs[l] = block;
+        block += model.UnitCount(l);
     }
 }
 
-void NeuralModel::ExportWeights()
+TrainingWorkspace::TrainingWorkspace()
 {
-    char** c = new char* [1];
-    c[0] = "../Data/weights.txt";
-    std::ofstream file(c[0]);
-    if (!file.bad()) {
-        file << this->hiddenLayerTotal << " " << this->inputDimension << " " << this->classCount;
-        for (int i = 0; i < this->hiddenLayerTotal; i++)
-            file << " " << layers[i].unitCount;
-        file << std::endl;
+    activations = nullptr;
+    signals = nullptr;
+    capacity = 0;
+    inputs = nullptr;
+    inputCapacity = 0;
+    rows = 0;
+    layerNanos = nullptr;
+    layerCount = 0;
+    timing = false;
+}
+
+TrainingWorkspace::~TrainingWorkspace()
+{
+    free_aligned(activations);
+    free_aligned(signals);
+    free_aligned(inputs);
+    delete[] layerNanos;
+}
+
+void TrainingWorkspace::Reserve(const NeuralModel& model, int rows)
+{
+    size_t totalUnits = 0;
+    for (int l = 0; l < model.LayerCount(); l++)
+        totalUnits += model.UnitCount(l);
+
+    size_t needed = (size_t)rows * totalUnits;
+    if (needed > capacity)
+    {
+        free_aligned(activations);
+        free_aligned(signals);
+        activations = alloc_aligned(needed);
+        signals = alloc_aligned(needed);
+        capacity = needed;
+    }
+    size_t inputNeeded = model.HasInputNormalization() ? (size_t)rows * model.InputDimension() : 0;
+    if (inputNeeded > inputCapacity)
+    {
+        free_aligned(inputs);
+        inputs = alloc_aligned(inputNeeded);
+        inputCapacity = inputNeeded;
+    }
+    if (model.LayerCount() != layerCount)
+    {
+        delete[] layerNanos;
+        layerCount = model.LayerCount();
+        layerNanos = new long long[3 * layerCount];
+    }
+    for (int p = 0; p < 3 * layerCount; p++)
+        layerNanos[p] = 0;
+    this->rows = rows;
+}
+
+bool NeuralModel::SaveWeights(const char* path) const
+{
+    if (this->parameters == nullptr)
+        return false;
+
+    WeightFileHeader header;
+    MakeWeightFileHeader(&header, this->hiddenLayerTotal, this->inputDimension, this->classCount, this->parameterCount);
+
+    int32_t* shape = new int32_t[this->hiddenLayerTotal + 1];
+    for (int l = 0; l < this->hiddenLayerTotal; l++)
+        shape[l] = unitCounts[l];
+    size_t shapeBytes = this->hiddenLayerTotal * sizeof(int32_t);
+    size_t arenaBytes = this->parameterCount * sizeof(float);
+    header.checksum = Crc32(this->parameters, arenaBytes, Crc32(shape, shapeBytes));
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    bool written = false;
+    if (file.is_open())
+    {
+        static const char zeros[WEIGHT_FILE_ALIGNMENT] = { 0 };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(shape), shapeBytes);
+        file.write(zeros, header.dataOffset - sizeof(header) - shapeBytes);
+        file.write(reinterpret_cast<const char*>(this->parameters), arenaBytes);
+        written = file.good();
+    }
+    delete[] shape;
+    return written;
+}
 
-        int size = this->inputDimension * this->layers[0].unitCount;
+bool NeuralModel::LoadWeights(const char* path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    file.seekg(0, std::ios::end);
+    std::streamoff fileSize = file.tellg();
+    file.seekg(0, std::ios::beg);
+    WeightFileHeader header;
+    if (fileSize < 0 || !file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || !ValidateWeightFileHeader(header, (uint64_t)fileSize))
+        return false;
+
+    int* shape = new int[header.hiddenLayerCount + 1];
+    size_t shapeBytes = header.hiddenLayerCount * sizeof(int32_t);
+    bool valid = (bool)file.read(reinterpret_cast<char*>(shape), shapeBytes);
+    for (int l = 0; valid && l < header.hiddenLayerCount; l++)
+        valid = shape[l] > 0;
+
+    // Lay the shape out in a scratch model first so a bad file leaves this
+    // one untouched
+    NeuralModel loaded;
+    if (valid)
+    {
+        loaded.layoutModel(header.hiddenLayerCount, shape, header.inputDimension, header.classCount);
+        valid = loaded.parameterCount == header.parameterCount;
+    }
+    if (valid)
+    {
+        size_t arenaBytes = loaded.parameterCount * sizeof(float);
+        loaded.parameters = alloc_aligned(loaded.parameterCount);
+        valid = file.seekg((std::streamoff)header.dataOffset)
+            && file.read(reinterpret_cast<char*>(loaded.parameters), arenaBytes)
+            && Crc32(loaded.parameters, arenaBytes, Crc32(shape, shapeBytes)) == header.checksum;
+    }
+    delete[] shape;
+    if (!valid)
+        return false;
+
+    swapModel(loaded);
+    return true;
+}
+
+bool NeuralModel::MapWeights(const char* path)
+{
+    MappedFile* file = new MappedFile();
+    if (!file->Open(path) || file->Size() < sizeof(WeightFileHeader))
+    {
+        delete file;
+        return false;
+    }
+
+    WeightFileHeader header;
+    memcpy(&header, file->Data(), sizeof(header));
+    bool valid = ValidateWeightFileHeader(header, file->Size());
+
+    const int32_t* shape = reinterpret_cast<const int32_t*>(file->Data() + sizeof(header));
+    size_t shapeBytes = valid ? header.hiddenLayerCount * sizeof(int32_t) : 0;
+    for (int l = 0; valid && l < header.hiddenLayerCount; l++)
+        valid = shape[l] > 0;
+
+    NeuralModel mapped;
+    if (valid)
+    {
+        mapped.layoutModel(header.hiddenLayerCount, shape, header.inputDimension, header.classCount);
+        float* arena = reinterpret_cast<float*>(file->Data() + header.dataOffset);
+        valid = mapped.parameterCount == header.parameterCount
+            && Crc32(arena, header.parameterCount * sizeof(float), Crc32(shape, shapeBytes)) == header.checksum;
+        mapped.parameters = arena;
+        mapped.mapping = file;
+    }
+    if (!valid)
+    {
+        // mapped releases the file if it took it over
+        if (mapped.mapping == nullptr)
+            delete file;
+        return false;
+    }
+
+    swapModel(mapped);
+    return true;
+}
+
+bool NeuralModel::ExportWeightsText(const char* path) const
+{
+    if (this->parameters == nullptr)
+        return false;
+    std::ofstream file(path);
+    if (!file.is_open())
+        return false;
+
+    // Enough digits to read every float back exactly
+    file.precision(std::numeric_limits<float>::max_digits10);
+    file << this->hiddenLayerTotal << " " << this->inputDimension << " " << this->classCount;
+    for (int i = 0; i < this->hiddenLayerTotal; i++)
+        file << " " << unitCounts[i];
+    file << std::endl;
+
+    for (int l = 0; l < LayerCount(); l++)
+    {
+        int size = FanIn(l) * unitCounts[l];
         for (int k = 0; k < size; k++)
-            file << weightMatrix[0][k] << " ";
+            file << weights(l)[k] << " ";
         file << std::endl;
-
-        for (int k = 0; k < this->layers[0].unitCount; k++)
-            file << offsetValues[0][k] << " ";
+        for (int k = 0; k < unitCounts[l]; k++)
+            file << offsets(l)[k] << " ";
         file << std::endl;
+    }
+    return file.good();
+}
 
-        for (int l = 0; l < this->hiddenLayerTotal; l++) {
-            int size = this->layers[l].unitCount * this->layers[l + 1].unitCount;
-            for (int k = 0; k < size; k++)
-                file << weightMatrix[l + 1][k] << " ";
-            file << std::endl;
-            for (int k = 0; k < this->layers[l + 1].unitCount; k++)
-                file << offsetValues[l + 1][k] << " ";
-            file << std::endl;
-        }
-        file.close();
-    }
-    else System::Windows::Forms::MessageBox::Show("Dosya açılamadı");
-    delete[] c;
-}
-
-void NeuralModel::InitializeFromWeightsFile()
-{
-    char** c = new char* [1];
-    std::ifstream file;
-    int LayerNum, Dim, numclass;
-    int* neuronCount;
-    c[0] = "../Data/weights.txt";
-    file.open(c[0]);
-    if (file.is_open()) {
-        file >> LayerNum >> Dim >> numclass;
-        neuronCount = new int[LayerNum];
-        for (int i = 0; i < LayerNum; i++)
-            file >> neuronCount[i];
-        this->InitializeModel(LayerNum, neuronCount, Dim, numclass);
-        int size = this->inputDimension * this->layers[0].unitCount;
-        for (int k = 0; k < size; k++)
-            file >> weightMatrix[0][k];
-        for (int k = 0; k < this->layers[0].unitCount; k++)
-            file >> offsetValues[0][k];
-
-        for (int l = 0; l < this->hiddenLayerTotal; l++) {
-            int size = this->layers[l].unitCount * this->layers[l + 1].unitCount;
-            for (int k = 0; k < size; k++)
-                file >> weightMatrix[l + 1][k];
-            for (int k = 0; k < this->layers[l + 1].unitCount; k++)
-                file >> offsetValues[l + 1][k];
+bool NeuralModel::ImportWeightsText(const char* path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        return false;
+
+    int layerNum, dim, numClass;
+    if (!(file >> layerNum >> dim >> numClass) || layerNum < 0 || dim <= 0 || numClass <= 0)
+        return false;
+    int* neuronCount = new int[layerNum + 1];
+    bool valid = true;
+    for (int i = 0; valid && i < layerNum; i++)
+        valid = (file >> neuronCount[i]) && neuronCount[i] > 0;
+
+    NeuralModel loaded;
+    if (valid)
+    {
+        loaded.InitializeModel(layerNum, neuronCount, dim, numClass);
+        for (int l = 0; valid && l < loaded.LayerCount(); l++)
+        {
+            int size = loaded.FanIn(l) * loaded.unitCounts[l];
+            for (int k = 0; valid && k < size; k++)
+                valid = (bool)(file >> loaded.weights(l)[k]);
+            for (int k = 0; valid && k < loaded.unitCounts[l]; k++)
+                valid = (bool)(file >> loaded.offsets(l)[k]);
         }
-        file.close();
-        System::String^ StringArray;
-        for (int i = 0; i < LayerNum; i++)
-            StringArray += System::Convert::ToString(neuronCount[i]) + " ";
-        System::Windows::Forms::MessageBox::Show("Dosya başarı ile okundu" + "\r\n"
-            + "Dimension:  " + System::Convert::ToString(Dim) + "\r\n"
-            + "Hidden Layer:  " + System::Convert::ToString(LayerNum) + "\r\n"
-            + "Neurons:  " + StringArray + "\r\n"
-            + "numClass:  " + System::Convert::ToString(numclass) + "\r\n"
-        );
     }
-    else System::Windows::Forms::MessageBox::Show("Ağırlık dosyası açılamadı");
+    delete[] neuronCount;
+    if (!valid)
+        return false;
+
+    swapModel(loaded);
+    return true;
 }
 
 NeuralModel::NeuralModel()
 {
+    parameters = nullptr;
+    mapping = nullptr;
+    parameterCount = 0;
+    inputMean = nullptr;
+    inputScale = nullptr;
+    masterParameters = nullptr;
+    trainingPrecision = PRECISION_FP32;
+    unitCounts = nullptr;
+    unitOffset = nullptr;
+    weightOffset = nullptr;
+    biasOffset = nullptr;
+    totalUnits = 0;
+    hiddenLayerTotal = 0;
+    inputDimension = 0;
+    classCount = 0;
 }
 
-NeuralModel::~NeuralModel()
+NeuralModel::NeuralModel(const NeuralModel& other)
+{
+    parameters = nullptr;
+    mapping = nullptr;
+    parameterCount = 0;
+    inputMean = nullptr;
+    inputScale = nullptr;
+    masterParameters = nullptr;
+    trainingPrecision = PRECISION_FP32;
+    unitCounts = nullptr;
+    unitOffset = nullptr;
+    weightOffset = nullptr;
+    biasOffset = nullptr;
+    totalUnits = 0;
+    hiddenLayerTotal = 0;
+    inputDimension = 0;
+    classCount = 0;
+    *this = other;
+}
+
+NeuralModel& NeuralModel::operator=(const NeuralModel& other)
+{
+    if (this == &other)
+        return *this;
+
+    if (other.parameters == nullptr)
+    {
+        releaseModel();
+        return *this;
+    }
+
+    // The same layout as other's, so the parameters (overwritten right
+    // away, hence no random initialization) are taken over with one copy
+    layoutModel(other.hiddenLayerTotal, other.unitCounts, other.inputDimension, other.classCount);
+    this->parameters = alloc_aligned(this->parameterCount);
+    CopyParametersFrom(other);
+    return *this;
+}
+
+void NeuralModel::publishSnapshot(TrainingSnapshots& snapshots, int epoch) const
 {
-    for (int i = 0; i < hiddenLayerTotal + 1; i++)
+    // Only the first publish into a buffer allocates
+    NeuralModel& snapshot = snapshots.backBuffer();
+    if (!snapshot.CopyParametersFrom(*this))
+        snapshot = *this;
+    if (masterParameters != nullptr)
+        memcpy(snapshot.parameters, masterParameters, this->parameterCount * sizeof(float));
+    if (snapshot.inputMean != nullptr)
+        snapshot.foldInputNormalization(true);
+    snapshots.swapBuffers(epoch);
+}
+
+bool NeuralModel::CopyParametersFrom(const NeuralModel& other)
+{
+    if (other.parameterCount != this->parameterCount || other.hiddenLayerTotal != this->hiddenLayerTotal
+        || other.inputDimension != this->inputDimension)
+        return false;
+    for (int l = 0; l < this->hiddenLayerTotal + 1; l++)
+        if (other.unitCounts[l] != this->unitCounts[l])
+            return false;
+
+    memcpy(this->parameters, other.parameters, this->parameterCount * sizeof(float));
+
+    // The copied parameters are folded with other's statistics
+    delete[] inputMean;
+    delete[] inputScale;
+    inputMean = nullptr;
+    inputScale = nullptr;
+    if (other.inputMean != nullptr)
     {
-        delete[] weightMatrix[i];
-        delete[] offsetValues[i];
+        inputMean = new float[this->inputDimension];
+        inputScale = new float[this->inputDimension];
+        memcpy(inputMean, other.inputMean, this->inputDimension * sizeof(float));
+        memcpy(inputScale, other.inputScale, this->inputDimension * sizeof(float));
     }
-    delete[] weightMatrix;
-    delete[] offsetValues;
-    delete[] layers;
-    delete[] errorHistory;
+    return true;
+}
+
+void NeuralModel::swapModel(NeuralModel& other)
+{
+    std::swap(parameters, other.parameters);
+    std::swap(mapping, other.mapping);
+    std::swap(parameterCount, other.parameterCount);
+    std::swap(inputMean, other.inputMean);
+    std::swap(inputScale, other.inputScale);
+    std::swap(weightOffset, other.weightOffset);
+    std::swap(biasOffset, other.biasOffset);
+    std::swap(unitCounts, other.unitCounts);
+    std::swap(unitOffset, other.unitOffset);
+    std::swap(totalUnits, other.totalUnits);
+    std::swap(hiddenLayerTotal, other.hiddenLayerTotal);
+    std::swap(inputDimension, other.inputDimension);
+    std::swap(classCount, other.classCount);
 }
+
+void NeuralModel::releaseModel()
+{
+    if (mapping != nullptr)
+        delete mapping;
+    else
+        free_aligned(parameters);
+    delete[] inputMean;
+    delete[] inputScale;
+    delete[] unitCounts;
+    delete[] unitOffset;
+    delete[] weightOffset;
+    delete[] biasOffset;
+
+    parameters = nullptr;
+    mapping = nullptr;
+    parameterCount = 0;
+    inputMean = nullptr;
+    inputScale = nullptr;
+    unitCounts = nullptr;
+    unitOffset = nullptr;
+    weightOffset = nullptr;
+    biasOffset = nullptr;
+    totalUnits = 0;
+    hiddenLayerTotal = 0;
+    inputDimension = 0;
+    classCount = 0;
+}
+
+NeuralModel::~NeuralModel()
+{
+    releaseModel();
+}
+
+#pragma managed(pop)
@@ -1,43 +1,193 @@
 #pragma once
+#include <cstddef>
+#include "TrainingConfig.h"
+#include "Telemetry.h"
 #define BIAS 1.0
+// Defaults of TrainingConfig and CreateOptimizer
 #define LEARNING_RATE 0.1
 #define EMAX 0.01
 #define CYCLE_MAX 30000
-#define MOMENT_RATE 0.99
-#define T_SIZE 2
+#define MOMENT_RATE 0.9
+#define BATCH_SIZE 32
+#define PARALLEL_GRAIN 256
+#define SNAPSHOT_INTERVAL 10
 
-struct ProcessingUnit
+class NeuralModel;
+class Optimizer;
+class MappedFile;
+class ThreadPool;
+class TrainingSnapshots;
+
+// Per-call scratch for NeuralModel::Predict. Keep one per thread; the model
+// itself is never written during inference, so any number of threads can
+// predict on a shared model as long as each uses its own workspace.
+class InferenceWorkspace
 {
-    float summedInput;
-    float activation;
-    ProcessingUnit() { summedInput = 0; activation = 0; };
+public:
+    InferenceWorkspace();
+    explicit InferenceWorkspace(const NeuralModel& model);
+    ~InferenceWorkspace();
+    // Grows the buffers to fit the model's shape
+    void Reserve(const NeuralModel& model);
+private:
+    friend class NeuralModel;
+    float* buffer;       // activations of every layer, back to back
+    int bufferSize;
+    float** layerActs;   // layerActs[l] points into buffer
+    int layerCapacity;
+    InferenceWorkspace(const InferenceWorkspace&);
+    InferenceWorkspace& operator=(const InferenceWorkspace&);
 };
 
-struct LayerUnit
+// Training scratch for one worker: activations and back-propagated signals
+// of every layer for up to Rows() samples, structure of arrays, plus the
+// normalized input rows of the current batch and the worker's phase timers.
+class TrainingWorkspace
 {
-    ProcessingUnit* units;
-    int unitCount;
-    ~LayerUnit() {
-        delete[] units;
-    }
+public:
+    TrainingWorkspace();
+    ~TrainingWorkspace();
+    // Grows the buffers to fit rows samples of the model's shape
+    void Reserve(const NeuralModel& model, int rows);
+    int Rows() const { return rows; }
+private:
+    friend class NeuralModel;
+    float* activations;
+    float* signals;
+    size_t capacity;    // floats in each buffer
+    float* inputs;      // only used with input normalization
+    size_t inputCapacity;
+    int rows;           // row stride of every layer block
+    long long* layerNanos;  // forward, backward and update time per layer
+    int layerCount;
+    bool timing;        // TrainingConfig::timeLayers
+    TrainingWorkspace(const TrainingWorkspace&);
+    TrainingWorkspace& operator=(const TrainingWorkspace&);
 };
 
 class NeuralModel
 {
 public:
     NeuralModel();
+    NeuralModel(const NeuralModel& other);
+    NeuralModel& operator=(const NeuralModel& other);
     ~NeuralModel();
     void InitializeModel(const int hiddenLayerCount, int* unitCounts, const int inputDimension, const int outputClassCount);
-    int performSGDTraining(float* trainingData, float* targetData, int sampleCount);
-    int performSGDTrainingWithMomentum(float* trainingData, float* targetData, int sampleCount);
-    void ExecuteTest(float* testData, int* predictedLabels, int dataCount);
-    void ExportWeights();
-    void InitializeFromWeightsFile();
-    double* errorHistory;
+    int performSGDTraining(const float* trainingData, const int* targetLabels, int sampleCount);
+    int performSGDTrainingWithMomentum(const float* trainingData, const int* targetLabels, int sampleCount);
+    int performMiniBatchTraining(const float* trainingData, const int* targetLabels, int sampleCount, int batchSize = BATCH_SIZE);
+    // Single training loop: forward/backward over batches of
+    // config.batchSize samples, one optimizer step per batch, until one of
+    // the stop rules of config fires. optimizer.learningRate is the base
+    // rate of the schedule and is restored on return.
+    TrainingResult Train(const float* trainingData, const int* targetLabels, int sampleCount, Optimizer& optimizer,
+        const TrainingConfig& config);
+    // Default config with the given batch size and parallelism. Returns the
+    // epoch at which the RMSE fell below EMAX, or 0 if it never did.
+    int Train(const float* trainingData, const int* targetLabels, int sampleCount, Optimizer& optimizer, int batchSize = 1,
+        TrainingParallelism parallelism = TRAIN_SERIAL, ThreadPool* pool = nullptr);
+    // Warm start after samples [firstNewSample, sampleCount) were appended
+    // to a set the model was already trained on: continues from the
+    // current weights (and optimizer state unless config.resetOptimizer)
+    // on the new samples plus a bounded random replay of the old ones.
+    // Inputs must use the same normalization as the first training.
+    TrainingResult TrainIncremental(const float* trainingData, const int* targetLabels, int sampleCount, int firstNewSample,
+        Optimizer& optimizer, const IncrementalConfig& config);
+    void Predict(const float* testData, int* predictedLabels, int dataCount, InferenceWorkspace& workspace) const;
+    void ExecuteTest(const float* testData, int* predictedLabels, int dataCount) const;
+    void ExecuteTestParallel(const float* testData, int* predictedLabels, int dataCount) const;
+    // Binary weight file (WeightFile.h). LoadWeights reads it into a new
+    // arena; MapWeights points the arena straight at a copy-on-write mapping
+    // of the file, so nothing is copied and training never writes back.
+    // All return false, leaving the model unchanged, if the file cannot be
+    // opened or fails validation.
+    bool SaveWeights(const char* path) const;
+    bool LoadWeights(const char* path);
+    bool MapWeights(const char* path);
+    bool IsMapped() const { return mapping != nullptr; }
+    // Whitespace separated text: shape line, then W0 b0 W1 b1 ... one per line
+    bool ExportWeightsText(const char* path) const;
+    bool ImportWeightsText(const char* path);
+    // Copies all weights and offsets of a model with the same shape (one
+    // memcpy) and its input normalization
+    bool CopyParametersFrom(const NeuralModel& other);
+    // Input normalization x' = (x - mean) / sqrt(variance). Once set, Train
+    // normalizes each batch on the fly and outside of Train the statistics
+    // are folded into W0 and b0, so every entry point takes raw features
+    // and inference needs no normalized copy. Weight files store the folded
+    // parameters without the statistics.
+    // SetInputNormalization keeps what the model computes: its parameters
+    // already take raw features (trained, loaded or read from a file), and
+    // only the space Train steps them in changes.
+    void SetInputNormalization(const float* mean, const float* variance);
+    // For parameters that work on normalized features (a fresh
+    // initialization, or weights trained on a normalized copy): replaces
+    // any statistics and folds these in, so the model takes raw features.
+    void AttachInputNormalization(const float* mean, const float* variance);
+    bool HasInputNormalization() const { return inputMean != nullptr; }
+    // Training RMSE of the last Train call, downsampled to fixed memory
+    TrainingHistory errorHistory;
+
+    // Shape: layer 0 .. LayerCount() - 1, the last one is the output layer
+    int LayerCount() const { return hiddenLayerTotal + 1; }
+    int UnitCount(int layer) const { return unitCounts[layer]; }
+    int FanIn(int layer) const { return layer == 0 ? inputDimension : unitCounts[layer - 1]; }
+    int InputDimension() const { return inputDimension; }
+    int ClassCount() const { return classCount; }
+
+    // Parameters of layer l: UnitCount(l) x FanIn(l) row-major weights and
+    // UnitCount(l) offsets, all inside one 64 byte aligned arena
+    const float* Weights(int layer) const { return parameters + weightOffset[layer]; }
+    const float* Offsets(int layer) const { return parameters + biasOffset[layer]; }
+    const float* Parameters() const { return parameters; }
+    size_t ParameterCount() const { return parameterCount; }
 private:
-    LayerUnit* layers;
-    float** weightMatrix;
-    float** offsetValues;
+    void releaseModel();
+    // Exchanges shape and arena (not errorHistory) with other
+    void swapModel(NeuralModel& other);
+    // Shape, offsets and unit counts; leaves the arena unallocated
+    void layoutModel(const int hiddenLayerCount, const int* unitCounts, const int inputDimension, const int outputClassCount);
+    // W0' = W0 diag(scale), b0' = b0 - W0' mean, or back when fold is false
+    void foldInputNormalization(bool fold);
+    // Normalized copy of the rows in ws, or input itself without normalization
+    const float* normalizeBatch(const float* input, int rows, TrainingWorkspace& ws) const;
+    void forwardBatch(const float* input, int rows, TrainingWorkspace& ws) const;
+    // Writes scale * dE/dparams of the rows into gradient, returns sum (t - a)^2
+    float backwardBatch(const float* input, const int* targetLabels, int rows, float scale, TrainingWorkspace& ws, float* gradient) const;
+    // Sum of (t - a)^2 over count samples, forward passes only
+    float evaluateError(const float* data, const int* targetLabels, int count, TrainingWorkspace& ws) const;
+    // optimizer.Step, one Update per layer when ws times the phases. In
+    // mixed precision the step goes to masterParameters and the updated
+    // range is rounded into parameters.
+    void stepParameters(Optimizer& optimizer, const float* gradient, TrainingWorkspace& ws);
+    float trainEpochSerial(const float* trainingData, const int* targetLabels, int sampleCount, int batchSize,
+        Optimizer& optimizer, TrainingWorkspace& ws, float* gradient);
+    float trainEpochSync(const float* trainingData, const int* targetLabels, int sampleCount, int batchSize,
+        Optimizer& optimizer, ThreadPool& pool, TrainingWorkspace* workspaces, float* shardGradients, float* gradient);
+    float trainEpochHogwild(const float* trainingData, const int* targetLabels, int sampleCount, int batchSize,
+        Optimizer& optimizer, ThreadPool& pool, TrainingWorkspace* workspaces, float* workerGradients);
+    int classifySample(const float* input, float* const* layerActs) const;
+    // Hands the state of a running Train to snapshots: the fp32 (master)
+    // parameters with the input normalization folded back in
+    void publishSnapshot(TrainingSnapshots& snapshots, int epoch) const;
+    float* weights(int layer) const { return parameters + weightOffset[layer]; }
+    float* offsets(int layer) const { return parameters + biasOffset[layer]; }
+    // Layer l of a workspace holds ws.Rows() x UnitCount(l) values
+    float* layerActivations(const TrainingWorkspace& ws, int layer) const { return ws.activations + (size_t)ws.rows * unitOffset[layer]; }
+    float* layerSignals(const TrainingWorkspace& ws, int layer) const { return ws.signals + (size_t)ws.rows * unitOffset[layer]; }
+
+    float* parameters;          // W0 b0 W1 b1 ... (64 byte aligned sections)
+    MappedFile* mapping;        // owns parameters when mapped from a file
+    size_t parameterCount;      // floats in the arena, padding included
+    size_t* weightOffset;       // start of W[l] in parameters
+    size_t* biasOffset;         // start of b[l] in parameters
+    float* inputMean;           // input normalization, null if none
+    float* inputScale;          // 1 / sqrt(variance)
+    float* masterParameters;    // fp32 copy while Train runs in bf16 / fp16, else null
+    WeightPrecision trainingPrecision;
+    int* unitCounts;            // units per layer
+    int* unitOffset;            // units in the layers before l
+    int totalUnits;             // units over all layers
     int hiddenLayerTotal; // HIDDEN LAYER COUNT
     int inputDimension;   // INPUT DIMENSION
     int classCount;       // CLASS COUNT
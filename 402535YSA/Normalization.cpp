@@ -0,0 +1,154 @@
+#include "pch.h"
+#include "Normalization.h"
+#include "ThreadPool.h"
+#include <math.h>
+#include <cstring>
+#include <vector>
+
+FeatureStats::FeatureStats(int dimension)
+{
+    this->dimension = 0;
+    count = 0;
+    mean = nullptr;
+    m2 = nullptr;
+    Reset(dimension);
+}
+
+FeatureStats::FeatureStats(const FeatureStats& other)
+{
+    dimension = 0;
+    count = 0;
+    mean = nullptr;
+    m2 = nullptr;
+    *this = other;
+}
+
+FeatureStats& FeatureStats::operator=(const FeatureStats& other)
+{
+    if (this == &other)
+        return *this;
+    Reset(other.dimension);
+    count = other.count;
+    if (dimension > 0)
+    {
+        memcpy(mean, other.mean, dimension * sizeof(double));
+        memcpy(m2, other.m2, dimension * sizeof(double));
+    }
+    return *this;
+}
+
+FeatureStats::~FeatureStats()
+{
+    delete[] mean;
+    delete[] m2;
+}
+
+void FeatureStats::Reset(int dimension)
+{
+    if (dimension != this->dimension)
+    {
+        delete[] mean;
+        delete[] m2;
+        mean = (dimension > 0) ? new double[dimension] : nullptr;
+        m2 = (dimension > 0) ? new double[dimension] : nullptr;
+        this->dimension = dimension;
+    }
+    for (int d = 0; d < dimension; d++)
+    {
+        mean[d] = 0;
+        m2[d] = 0;
+    }
+    count = 0;
+}
+
+void FeatureStats::addSerial(const float* samples, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        // One division per sample, shared by every feature
+        this->count++;
+        double inverseCount = 1.0 / (double)this->count;
+        const float* x = samples + (size_t)i * dimension;
+        for (int d = 0; d < dimension; d++)
+        {
+            double delta = x[d] - mean[d];
+            mean[d] += delta * inverseCount;
+            m2[d] += delta * (x[d] - mean[d]);
+        }
+    }
+}
+
+void FeatureStats::Add(const float* samples, int count, ThreadPool* pool)
+{
+    if (count <= NORMALIZATION_GRAIN)
+    {
+        addSerial(samples, count);
+        return;
+    }
+
+    int blocks = (count + NORMALIZATION_GRAIN - 1) / NORMALIZATION_GRAIN;
+    std::vector<FeatureStats> partials(blocks, FeatureStats(dimension));
+    ThreadPool& workerPool = (pool != nullptr) ? *pool : DefaultThreadPool();
+    workerPool.ParallelFor(blocks, 1, [&](int begin, int end, int) {
+        for (int b = begin; b < end; b++)
+        {
+            int first = b * NORMALIZATION_GRAIN;
+            int rows = (count - first < NORMALIZATION_GRAIN) ? count - first : NORMALIZATION_GRAIN;
+            partials[b].addSerial(samples + (size_t)first * dimension, rows);
+        }
+    });
+    for (int b = 0; b < blocks; b++)
+        Merge(partials[b]);
+}
+
+void FeatureStats::Merge(const FeatureStats& other)
+{
+    if (other.count == 0 || other.dimension != dimension)
+        return;
+    double total = (double)(count + other.count);
+    double otherShare = other.count / total;
+    double cross = (double)count * other.count / total;
+    for (int d = 0; d < dimension; d++)
+    {
+        double delta = other.mean[d] - mean[d];
+        mean[d] += delta * otherShare;
+        m2[d] += other.m2[d] + delta * delta * cross;
+    }
+    count += other.count;
+}
+
+void FeatureStats::Export(float* mean, float* variance) const
+{
+    for (int d = 0; d < dimension; d++)
+    {
+        mean[d] = (float)this->mean[d];
+        variance[d] = (count > 0) ? (float)(m2[d] / count) : 0.0f;
+    }
+}
+
+void InverseStdDev(const float* variance, float* invStd, int dimension)
+{
+    for (int d = 0; d < dimension; d++)
+        invStd[d] = (variance[d] > 0) ? (float)(1.0 / sqrt((double)variance[d])) : 1.0f;
+}
+
+static void normalizeRows(const float* in, float* out, int rows, int dimension, const float* mean, const float* invStd)
+{
+    for (int r = 0; r < rows; r++)
+        for (int d = 0; d < dimension; d++)
+            out[(size_t)r * dimension + d] = (in[(size_t)r * dimension + d] - mean[d]) * invStd[d];
+}
+
+void NormalizeFeatures(const float* in, float* out, int count, int dimension, const float* mean, const float* invStd,
+    ThreadPool* pool)
+{
+    if (count <= NORMALIZATION_GRAIN)
+    {
+        normalizeRows(in, out, count, dimension, mean, invStd);
+        return;
+    }
+    ThreadPool& workerPool = (pool != nullptr) ? *pool : DefaultThreadPool();
+    workerPool.ParallelFor(count, NORMALIZATION_GRAIN, [&](int begin, int end, int) {
+        normalizeRows(in + (size_t)begin * dimension, out + (size_t)begin * dimension, end - begin, dimension, mean, invStd);
+    });
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+class ThreadPool;
+
+// Samples per block of the parallel passes; inputs up to one block run serially
+#define NORMALIZATION_GRAIN 16384
+
+// Per-feature count, mean and sum of squared deviations, updated with
+// Welford's recurrence in double. Statistics of disjoint sample ranges merge
+// exactly (Chan et al.), so a pass can be split across threads or continued
+// as samples are appended.
+class FeatureStats
+{
+public:
+    explicit FeatureStats(int dimension = 0);
+    FeatureStats(const FeatureStats& other);
+    FeatureStats& operator=(const FeatureStats& other);
+    ~FeatureStats();
+    // Forgets every sample; a new dimension reallocates
+    void Reset(int dimension);
+    // Folds count row-major samples of Dimension() floats into the
+    // statistics. Inputs larger than NORMALIZATION_GRAIN are split into
+    // blocks on pool (DefaultThreadPool() if null) whose partial statistics
+    // merge in block order, so the result does not depend on the threads.
+    void Add(const float* samples, int count, ThreadPool* pool = nullptr);
+    void Merge(const FeatureStats& other);
+    long long Count() const { return count; }
+    int Dimension() const { return dimension; }
+    // Mean and population variance; both zero before the first sample
+    void Export(float* mean, float* variance) const;
+private:
+    void addSerial(const float* samples, int count);
+    int dimension;
+    long long count;
+    double* mean;
+    double* m2;         // sum of squared deviations from mean
+};
+
+// invStd[d] = 1 / sqrt(variance[d]); a feature with zero variance gets 1 so
+// it is only centered
+void InverseStdDev(const float* variance, float* invStd, int dimension);
+
+// out = (in - mean) * invStd for count rows of dimension floats; out may be
+// in. Inputs larger than NORMALIZATION_GRAIN rows run on pool
+// (DefaultThreadPool() if null).
+void NormalizeFeatures(const float* in, float* out, int count, int dimension, const float* mean, const float* invStd,
+    ThreadPool* pool = nullptr);
@@ -0,0 +1,180 @@
+#include "pch.h"
+#include "Optimizer.h"
+#include "NeuralNetwork.h"
+#include "Process.h"
+#include "Kernels.h"
+#include <atomic>
+#include <cstring>
+
+struct Optimizer::StepCounter
+{
+    std::atomic<long long> value{ 0 };
+};
+
+Optimizer::Optimizer(float learningRate)
+{
+    this->learningRate = learningRate;
+    state = nullptr;
+    count = 0;
+    steps = new StepCounter;
+}
+
+Optimizer::~Optimizer()
+{
+    free_aligned(state);
+    delete steps;
+}
+
+void Optimizer::Initialize(size_t parameterCount)
+{
+    if (parameterCount != count || (state == nullptr && StateWidth() > 0))
+    {
+        free_aligned(state);
+        state = (StateWidth() > 0) ? alloc_aligned(parameterCount * StateWidth()) : nullptr;
+        count = parameterCount;
+    }
+    Reset();
+}
+
+void Optimizer::Reset()
+{
+    if (state != nullptr)
+        memset(state, 0, count * StateWidth() * sizeof(float));
+    steps->value.store(0, std::memory_order_relaxed);
+}
+
+void Optimizer::BeginStep()
+{
+    // Only the count matters, not its order against the parameter updates
+    steps->value.fetch_add(1, std::memory_order_relaxed);
+}
+
+long long Optimizer::StepCount() const
+{
+    return steps->value.load(std::memory_order_relaxed);
+}
+
+void Optimizer::Step(float* params, const float* gradient)
+{
+    BeginStep();
+    Update(params, gradient, 0, count);
+}
+
+SGDOptimizer::SGDOptimizer(float learningRate) : Optimizer(learningRate)
+{
+}
+
+void SGDOptimizer::Update(float* params, const float* gradient, size_t begin, size_t end)
+{
+    g_kernels.axpy(-learningRate, gradient + begin, params + begin, (int)(end - begin));
+}
+
+MomentumOptimizer::MomentumOptimizer(float learningRate, float momentum) : Optimizer(learningRate)
+{
+    this->momentum = momentum;
+}
+
+void MomentumOptimizer::Update(float* params, const float* gradient, size_t begin, size_t end)
+{
+    g_kernels.momentum(-(1 - momentum) * learningRate, gradient + begin, params + begin, state + begin, momentum,
+        (int)(end - begin));
+}
+
+NesterovOptimizer::NesterovOptimizer(float learningRate, float momentum) : Optimizer(learningRate)
+{
+    this->momentum = momentum;
+}
+
+void NesterovOptimizer::Update(float* params, const float* gradient, size_t begin, size_t end)
+{
+    float mu = momentum;
+    float step = (1 - mu) * learningRate;
+    float* velocity = state;
+    for (size_t i = begin; i < end; i++)
+    {
+        float g = gradient[i];
+        float v = mu * velocity[i] - step * g;
+        velocity[i] = v;
+        params[i] += mu * v - step * g;
+    }
+}
+
+RMSPropOptimizer::RMSPropOptimizer(float learningRate, float decay) : Optimizer(learningRate)
+{
+    this->decay = decay;
+}
+
+void RMSPropOptimizer::Update(float* params, const float* gradient, size_t begin, size_t end)
+{
+    float rho = decay;
+    float lr = learningRate;
+    float* meanSquare = state;
+    for (size_t i = begin; i < end; i++)
+    {
+        float g = gradient[i];
+        float s = rho * meanSquare[i] + (1 - rho) * g * g;
+        meanSquare[i] = s;
+        params[i] -= lr * g / (sqrtf(s) + (float)OPTIMIZER_EPSILON);
+    }
+}
+
+AdamOptimizer::AdamOptimizer(float learningRate, float beta1, float beta2) : Optimizer(learningRate)
+{
+    this->beta1 = beta1;
+    this->beta2 = beta2;
+}
+
+void AdamOptimizer::Update(float* params, const float* gradient, size_t begin, size_t end)
+{
+    float b1 = beta1, b2 = beta2;
+    double t = (double)StepCount();
+    // Bias correction folded into the step size
+    float correction1 = 1 - (float)pow((double)b1, t);
+    float correction2 = 1 - (float)pow((double)b2, t);
+    float step = learningRate * sqrtf(correction2) / correction1;
+    float eps = (float)OPTIMIZER_EPSILON * sqrtf(correction2);
+
+    float* m = state;
+    float* v = state + count;
+    for (size_t i = begin; i < end; i++)
+    {
+        float g = gradient[i];
+        float mi = b1 * m[i] + (1 - b1) * g;
+        float vi = b2 * v[i] + (1 - b2) * g * g;
+        m[i] = mi;
+        v[i] = vi;
+        params[i] -= step * mi / (sqrtf(vi) + eps);
+    }
+}
+
+Optimizer* CreateOptimizer(OptimizerType type)
+{
+    switch (type)
+    {
+    case OPTIMIZER_MOMENTUM: return new MomentumOptimizer((float)LEARNING_RATE, (float)MOMENT_RATE);
+    case OPTIMIZER_NESTEROV: return new NesterovOptimizer((float)LEARNING_RATE, (float)MOMENT_RATE);
+    case OPTIMIZER_RMSPROP:  return new RMSPropOptimizer((float)RMSPROP_LEARNING_RATE);
+    case OPTIMIZER_ADAM:     return new AdamOptimizer((float)ADAM_LEARNING_RATE);
+    default:                 return new SGDOptimizer((float)LEARNING_RATE);
+    }
+}
+
+bool OptimizerFromName(const char* name, OptimizerType* type)
+{
+    static const struct { const char* name; OptimizerType type; } names[] = {
+        { "SGD", OPTIMIZER_SGD },
+        { "SGDwMomentum", OPTIMIZER_MOMENTUM },
+        { "Nesterov", OPTIMIZER_NESTEROV },
+        { "RMSProp", OPTIMIZER_RMSPROP },
+        { "Adam", OPTIMIZER_ADAM },
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        if (strcmp(names[i].name, name) == 0)
+        {
+            *type = names[i].type;
+            return true;
+        }
+    }
+    return false;
+}
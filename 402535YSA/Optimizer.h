@@ -0,0 +1,136 @@
+#pragma once
+#include <cstddef>
+
+#define ADAM_LEARNING_RATE 0.01
+#define ADAM_BETA1 0.9
+#define ADAM_BETA2 0.999
+#define RMSPROP_LEARNING_RATE 0.01
+#define RMSPROP_DECAY 0.9
+#define OPTIMIZER_EPSILON 1e-8
+
+enum OptimizerType
+{
+    OPTIMIZER_SGD = 0,
+    OPTIMIZER_MOMENTUM,
+    OPTIMIZER_NESTEROV,
+    OPTIMIZER_RMSPROP,
+    OPTIMIZER_ADAM
+};
+
+// Updates a parameter arena from a gradient with the same layout. The state
+// of every optimizer lives in one contiguous aligned buffer and each Step is
+// a single fused pass over parameters, gradient and state.
+class Optimizer
+{
+public:
+    explicit Optimizer(float learningRate);
+    virtual ~Optimizer();
+
+    // (Re)allocates zeroed state for parameterCount parameters
+    void Initialize(size_t parameterCount);
+    // Clears the state without reallocating it
+    void Reset();
+    size_t ParameterCount() const { return count; }
+
+    // params -= update(gradient), gradient = dE/dparams averaged over the batch.
+    // TRAIN_HOGWILD calls this from several threads at once without locks;
+    // concurrent steps may then lose individual element updates.
+    void Step(float* params, const float* gradient);
+    // Step in pieces: BeginStep once, then Update over disjoint ranges
+    // [begin, end) of the arena that together cover it (per-layer timing)
+    void BeginStep();
+    virtual void Update(float* params, const float* gradient, size_t begin, size_t end) = 0;
+
+    virtual OptimizerType Type() const = 0;
+    virtual const char* Name() const = 0;
+
+    float learningRate;
+protected:
+    // floats of state kept per parameter
+    virtual int StateWidth() const = 0;
+    float* state;
+    size_t count;
+    // Steps begun so far. An atomic counter (behind a pointer, so the form
+    // can include this header from /clr code): TRAIN_HOGWILD begins steps
+    // from several threads, and Update takes one snapshot of it.
+    long long StepCount() const;
+private:
+    struct StepCounter;
+    StepCounter* steps;
+    Optimizer(const Optimizer&);
+    Optimizer& operator=(const Optimizer&);
+};
+
+// w -= lr * g
+class SGDOptimizer : public Optimizer
+{
+public:
+    explicit SGDOptimizer(float learningRate);
+    void Update(float* params, const float* gradient, size_t begin, size_t end);
+    OptimizerType Type() const { return OPTIMIZER_SGD; }
+    const char* Name() const { return "SGD"; }
+protected:
+    int StateWidth() const { return 0; }
+};
+
+// v = mu * v - (1 - mu) * lr * g, w += v
+// The velocity is a moving average of SGD steps, so the effective step size
+// stays lr for any mu.
+class MomentumOptimizer : public Optimizer
+{
+public:
+    MomentumOptimizer(float learningRate, float momentum);
+    void Update(float* params, const float* gradient, size_t begin, size_t end);
+    OptimizerType Type() const { return OPTIMIZER_MOMENTUM; }
+    const char* Name() const { return "SGDwMomentum"; }
+    float momentum;
+protected:
+    int StateWidth() const { return 1; }
+};
+
+// Same velocity as MomentumOptimizer, but the step looks ahead along it:
+// w += mu * v_new - (1 - mu) * lr * g
+class NesterovOptimizer : public Optimizer
+{
+public:
+    NesterovOptimizer(float learningRate, float momentum);
+    void Update(float* params, const float* gradient, size_t begin, size_t end);
+    OptimizerType Type() const { return OPTIMIZER_NESTEROV; }
+    const char* Name() const { return "Nesterov"; }
+    float momentum;
+protected:
+    int StateWidth() const { return 1; }
+};
+
+// s = rho * s + (1 - rho) * g^2, w -= lr * g / (sqrt(s) + eps)
+class RMSPropOptimizer : public Optimizer
+{
+public:
+    RMSPropOptimizer(float learningRate, float decay = (float)RMSPROP_DECAY);
+    void Update(float* params, const float* gradient, size_t begin, size_t end);
+    OptimizerType Type() const { return OPTIMIZER_RMSPROP; }
+    const char* Name() const { return "RMSProp"; }
+    float decay;
+protected:
+    int StateWidth() const { return 1; }
+};
+
+// Bias-corrected first and second moments; state holds m then v
+class AdamOptimizer : public Optimizer
+{
+public:
+    AdamOptimizer(float learningRate, float beta1 = (float)ADAM_BETA1, float beta2 = (float)ADAM_BETA2);
+    void Update(float* params, const float* gradient, size_t begin, size_t end);
+    OptimizerType Type() const { return OPTIMIZER_ADAM; }
+    const char* Name() const { return "Adam"; }
+    float beta1, beta2;
+protected:
+    int StateWidth() const { return 2; }
+};
+
+// Optimizer with this repo's default hyperparameters for the given type
+Optimizer* CreateOptimizer(OptimizerType type);
+
+// Maps a name shown in the optimization box ("SGD", "SGDwMomentum",
+// "Nesterov", "RMSProp", "Adam") to its type. Returns false if unknown.
+bool OptimizerFromName(const char* name, OptimizerType* type);
@@ -1,33 +1,45 @@
 #include "pch.h"
+#include "Process.h"
+#include "Normalization.h"
 #include <cmath>
-
-float* Add_Data(float* sample, int Size, float* x, int Dim) {
-    float* temp = new float[Size * Dim];
-    for (int i = 0; i < (Size - 1) * Dim; i++) {
-        temp[i] = sample[i];
-    }
-    for (int i = 0; i < Dim; i++) {
-        temp[(Size - 1) * Dim + i] = x[i];
-    }
-    delete[] sample;
-    return temp;
-}
-
-float* Add_Labels(float* Labels, int Size, int label) {
-    float* temp = new float[Size];
-    for (int i = 0; i < Size - 1; i++) {
-        temp[i] = Labels[i];
-    }
-    temp[Size - 1] = static_cast<float>(label);
-    delete[] Labels;
-    return temp;
-}
+#include <cstdlib>
 
 float* init_array_random(int len) {
     float* arr = new float[len];
+    fill_array_random(arr, len);
+    return arr;
+}
+
+void fill_array_random(float* arr, int len) {
     for (int i = 0; i < len; i++)
         arr[i] = ((float)rand() / RAND_MAX) - 0.5f;
-    return arr;
+}
+
+// 64 byte (cache line / AVX-512 register) aligned float buffers
+float* alloc_aligned(size_t len) {
+    if (len == 0)
+        len = 1;
+#ifdef _MSC_VER
+    return static_cast<float*>(_aligned_malloc(len * sizeof(float), 64));
+#else
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, 64, len * sizeof(float)) != 0)
+        return nullptr;
+    return static_cast<float*>(ptr);
+#endif
+}
+
+void free_aligned(float* arr) {
+#ifdef _MSC_VER
+    _aligned_free(arr);
+#else
+    free(arr);
+#endif
+}
+
+// Rounds a float count up to a whole number of 64 byte lines
+size_t align_floats(size_t len) {
+    return (len + 15) & ~(size_t)15;
 }
 
 float* init_array_zero(int len) {
@@ -37,55 +49,24 @@ float* init_array_zero(int len) {
     return arr;
 }
 
-void push_back(float*** arr, int lIndex, int wIndex, int size, float item) {
-    for (int t = 0; t < size - 1; t++) {
-        arr[lIndex][wIndex][t] = arr[lIndex][wIndex][t + 1];
-    }
-    arr[lIndex][wIndex][size - 1] = item;
+// Per-feature mean and (population) variance of the samples, one Welford pass
+void Batch_Stats(const float* Samples, int numSample, int inputDim, float mean[], float variance[])
+{
+    FeatureStats stats(inputDim);
+    stats.Add(Samples, numSample);
+    stats.Export(mean, variance);
 }
 
-float* Batch_Norm(float* Samples, int numSample, int inputDim, float mean[], float variance[], bool copy)
+float* Batch_Norm(const float* Samples, int numSample, int inputDim, float mean[], float variance[], bool copy)
 {
-    float* normalizedSamples = new float[numSample * inputDim];
-    if (copy == true) {
-        for (int i = 0; i < inputDim; i++) {
-            mean[i] = 0.0f;
-            variance[i] = 0.0f;
-        }
-
-        for (int i = 0; i < numSample; i++) {
-            for (int j = 0; j < inputDim; j++) {
-                mean[j] += static_cast<float>(Samples[i * inputDim + j]);
-            }
-        }
-        for (int j = 0; j < inputDim; j++) {
-            mean[j] /= numSample;
-        }
-
-        for (int i = 0; i < numSample; i++) {
-            for (int j = 0; j < inputDim; j++) {
-                float diff = Samples[i * inputDim + j] - mean[j];
-                variance[j] += diff * diff;
-            }
-        }
-
-        for (int j = 0; j < inputDim; j++) {
-            variance[j] /= numSample;
-        }
-
-        for (int i = 0; i < numSample; i++) {
-            for (int j = 0; j < inputDim; j++) {
-                normalizedSamples[i * inputDim + j] = (Samples[i * inputDim + j] - mean[j]) / sqrt(variance[j]);
-            }
-        }
-    }
-    else
-    {
-        for (int i = 0; i < numSample; i++)
-            for (int j = 0; j < inputDim; j++)
-                normalizedSamples[i * inputDim + j] = (Samples[i * inputDim + j] - mean[j]) / sqrt(variance[j]);
-    }
+    if (copy == true)
+        Batch_Stats(Samples, numSample, inputDim, mean, variance);
 
+    float* invStd = new float[inputDim];
+    InverseStdDev(variance, invStd, inputDim);
+    float* normalizedSamples = new float[numSample * inputDim];
+    NormalizeFeatures(Samples, normalizedSamples, numSample, inputDim, mean, invStd);
+    delete[] invStd;
     return normalizedSamples;
 }
 
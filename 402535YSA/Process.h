@@ -1,9 +1,14 @@
 #pragma once
+#include <cstddef>
 
-float* Add_Data(float* sample, int Size, float* x, int Dim);
-float* Add_Labels(float* Labels, int Size, int label);
 float* init_array_random(int len);
 float* init_array_zero(int len);
-void push_back(float*** momentW, int lIndex, int wIndex, int size, float item);
-float* Batch_Norm(float* Samples, int numSample, int inputDim, float mean[], float variance[], bool copy = true);
+void fill_array_random(float* arr, int len);
+float* alloc_aligned(size_t len);
+void free_aligned(float* arr);
+size_t align_floats(size_t len);
+void Batch_Stats(const float* Samples, int numSample, int inputDim, float mean[], float variance[]);
+// Normalized copy (FeatureStats / NormalizeFeatures in Normalization.h);
+// copy = false reuses the given mean and variance
+float* Batch_Norm(const float* Samples, int numSample, int inputDim, float mean[], float variance[], bool copy = true);
 int YPoint(int x, float w[], float bias, float Carpan = 1.0);
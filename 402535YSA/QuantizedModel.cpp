@@ -0,0 +1,356 @@
+#include "pch.h"
+#include "QuantizedModel.h"
+#include "NeuralNetwork.h"
+#include "Kernels.h"
+#include "Process.h"
+#include "ThreadPool.h"
+#include <math.h>
+#include <cfloat>
+#include <cstring>
+#include <vector>
+
+#define QUANT_MAX 127.0f
+
+static inline signed char quantizeValue(float v)
+{
+    if (v > QUANT_MAX)
+        v = QUANT_MAX;
+    if (v < -QUANT_MAX)
+        v = -QUANT_MAX;
+    return (signed char)lrintf(v);
+}
+
+static size_t roundUpBlock(size_t n)
+{
+    return (n + KERNEL_INT8_BLOCK - 1) / KERNEL_INT8_BLOCK * KERNEL_INT8_BLOCK;
+}
+
+// fp32 forward pass of model into acts (layer l at acts + unitOffset[l])
+static void forwardFloat(const NeuralModel& model, const float* input, float* acts, const int* unitOffset)
+{
+    const float* prev = input;
+    for (int l = 0; l < model.LayerCount(); l++)
+    {
+        int fanIn = model.FanIn(l);
+        float* out = acts + unitOffset[l];
+        for (int j = 0; j < model.UnitCount(l); j++)
+            out[j] = g_kernels.dot(prev, model.Weights(l) + j * fanIn, fanIn) + model.Offsets(l)[j];
+        g_kernels.tanh(out, model.UnitCount(l));
+        prev = out;
+    }
+}
+
+QuantizedModel::QuantizedModel()
+{
+    weights = nullptr;
+    weightOffset = nullptr;
+    rowStride = nullptr;
+    inputOffset = nullptr;
+    inputTotal = 0;
+    rowSums = nullptr;
+    rowScale = nullptr;
+    offsets = nullptr;
+    unitOffset = nullptr;
+    inputCenter = nullptr;
+    inputInverseScale = nullptr;
+    activationInverseScale = nullptr;
+    unitCounts = nullptr;
+    layerTotal = 0;
+    inputDimension = 0;
+    maxUnits = 0;
+}
+
+QuantizedModel::~QuantizedModel()
+{
+    release();
+}
+
+void QuantizedModel::release()
+{
+    free_aligned(reinterpret_cast<float*>(weights));
+    delete[] weightOffset;
+    delete[] rowStride;
+    delete[] inputOffset;
+    delete[] rowSums;
+    delete[] rowScale;
+    delete[] offsets;
+    delete[] unitOffset;
+    delete[] inputCenter;
+    delete[] inputInverseScale;
+    delete[] activationInverseScale;
+    delete[] unitCounts;
+
+    weights = nullptr;
+    weightOffset = nullptr;
+    rowStride = nullptr;
+    inputOffset = nullptr;
+    inputTotal = 0;
+    rowSums = nullptr;
+    rowScale = nullptr;
+    offsets = nullptr;
+    unitOffset = nullptr;
+    inputCenter = nullptr;
+    inputInverseScale = nullptr;
+    activationInverseScale = nullptr;
+    unitCounts = nullptr;
+    layerTotal = 0;
+    inputDimension = 0;
+    maxUnits = 0;
+}
+
+bool QuantizedModel::Quantize(const NeuralModel& model, const float* calibrationData, int calibrationCount)
+{
+    if (model.Parameters() == nullptr || calibrationCount <= 0)
+        return false;
+    release();
+
+    layerTotal = model.LayerCount();
+    inputDimension = model.InputDimension();
+    unitCounts = new int[layerTotal];
+    unitOffset = new int[layerTotal];
+    rowStride = new int[layerTotal];
+    weightOffset = new size_t[layerTotal];
+    inputOffset = new size_t[layerTotal];
+    activationInverseScale = new float[layerTotal];
+
+    // Layout: every weight row and every layer input padded to whole blocks
+    int units = 0;
+    size_t weightBytes = 0;
+    for (int l = 0; l < layerTotal; l++)
+    {
+        unitCounts[l] = model.UnitCount(l);
+        unitOffset[l] = units;
+        units += unitCounts[l];
+        if (unitCounts[l] > maxUnits)
+            maxUnits = unitCounts[l];
+
+        rowStride[l] = (int)roundUpBlock(model.FanIn(l));
+        weightOffset[l] = weightBytes;
+        weightBytes += (size_t)rowStride[l] * unitCounts[l];
+        inputOffset[l] = inputTotal;
+        inputTotal += rowStride[l];
+    }
+    rowSums = new int[units];
+    rowScale = new float[units];
+    offsets = new float[units];
+    inputCenter = new float[inputDimension];
+    inputInverseScale = new float[inputDimension];
+
+    // Calibration: range of every input feature and max |a| of every
+    // hidden layer over the fp32 forward passes
+    std::vector<float> low(inputDimension, FLT_MAX), high(inputDimension, -FLT_MAX);
+    std::vector<float> maxActivation(layerTotal, 0.0f);
+    std::vector<float> acts(units);
+    for (int i = 0; i < calibrationCount; i++)
+    {
+        const float* x = calibrationData + (size_t)i * inputDimension;
+        for (int d = 0; d < inputDimension; d++)
+        {
+            if (x[d] < low[d])
+                low[d] = x[d];
+            if (x[d] > high[d])
+                high[d] = x[d];
+        }
+        forwardFloat(model, x, acts.data(), unitOffset);
+        for (int l = 0; l + 1 < layerTotal; l++)
+            for (int j = 0; j < unitCounts[l]; j++)
+                if (fabsf(acts[unitOffset[l] + j]) > maxActivation[l + 1])
+                    maxActivation[l + 1] = fabsf(acts[unitOffset[l] + j]);
+    }
+
+    // Step size of every input of a layer: per feature for layer 0 (with
+    // the center folded into the offsets), one per hidden layer
+    std::vector<float> inputStep(inputDimension);
+    for (int d = 0; d < inputDimension; d++)
+    {
+        float half = 0.5f * (high[d] - low[d]);
+        inputCenter[d] = 0.5f * (high[d] + low[d]);
+        inputStep[d] = half / QUANT_MAX;
+        inputInverseScale[d] = (half > 0) ? QUANT_MAX / half : 0.0f; // a constant feature is all center
+    }
+    activationInverseScale[0] = 0;
+    for (int l = 1; l < layerTotal; l++)
+    {
+        float range = (maxActivation[l] > 0) ? maxActivation[l] : 1.0f;
+        activationInverseScale[l] = QUANT_MAX / range;
+    }
+
+    weights = reinterpret_cast<signed char*>(alloc_aligned((weightBytes + 3) / 4));
+    memset(weights, 0, weightBytes);
+    std::vector<float> row;
+    for (int l = 0; l < layerTotal; l++)
+    {
+        int fanIn = model.FanIn(l);
+        row.resize(fanIn);
+        for (int j = 0; j < unitCounts[l]; j++)
+        {
+            const float* w = model.Weights(l) + (size_t)j * fanIn;
+            double offset = model.Offsets(l)[j];
+            for (int k = 0; k < fanIn; k++)
+            {
+                if (l == 0)
+                {
+                    row[k] = w[k] * inputStep[k];
+                    offset += (double)w[k] * inputCenter[k];
+                }
+                else
+                    row[k] = w[k] / activationInverseScale[l];
+            }
+
+            float maxWeight = 0;
+            for (int k = 0; k < fanIn; k++)
+                if (fabsf(row[k]) > maxWeight)
+                    maxWeight = fabsf(row[k]);
+            float scale = (maxWeight > 0) ? maxWeight / QUANT_MAX : 1.0f;
+
+            signed char* q = weights + weightOffset[l] + (size_t)j * rowStride[l];
+            int sum = 0;
+            for (int k = 0; k < fanIn; k++)
+            {
+                q[k] = quantizeValue(row[k] / scale);
+                sum += q[k];
+            }
+            rowSums[unitOffset[l] + j] = sum;
+            rowScale[unitOffset[l] + j] = scale;
+            offsets[unitOffset[l] + j] = (float)offset;
+        }
+    }
+    return true;
+}
+
+int QuantizedModel::classifySample(const float* input, QuantizedWorkspace& ws) const
+{
+    signed char* in = ws.inputs + inputOffset[0];
+    for (int d = 0; d < inputDimension; d++)
+        in[d] = quantizeValue((input[d] - inputCenter[d]) * inputInverseScale[d]);
+
+    float* sums = ws.sums;
+    for (int l = 0; l < layerTotal; l++)
+    {
+        const float* scale = rowScale + unitOffset[l];
+        const float* offset = offsets + unitOffset[l];
+        g_kernels.gemvInt8(weights + weightOffset[l], unitCounts[l], rowStride[l], ws.inputs + inputOffset[l],
+            rowSums + unitOffset[l], ws.dots);
+        for (int j = 0; j < unitCounts[l]; j++)
+            sums[j] = scale[j] * (float)ws.dots[j] + offset[j];
+
+        if (l == layerTotal - 1)
+            break;
+        // tanh is monotonic, so the output layer's argmax skips it
+        g_kernels.tanh(sums, unitCounts[l]);
+        signed char* next = ws.inputs + inputOffset[l + 1];
+        float inverse = activationInverseScale[l + 1];
+        for (int j = 0; j < unitCounts[l]; j++)
+            next[j] = quantizeValue(sums[j] * inverse);
+    }
+
+    int maxIndex = 0;
+    float tempMax = -FLT_MAX;
+    for (int j = 0; j < ClassCount(); j++)
+    {
+        if (sums[j] > tempMax)
+        {
+            tempMax = sums[j];
+            maxIndex = j;
+        }
+    }
+    return maxIndex;
+}
+
+void QuantizedModel::Predict(const float* testData, int* predictedLabels, int dataCount, QuantizedWorkspace& workspace) const
+{
+    workspace.Reserve(*this);
+    for (int sample = 0; sample < dataCount; sample++)
+        predictedLabels[sample] = classifySample(testData + (size_t)sample * inputDimension, workspace);
+}
+
+void QuantizedModel::ExecuteTest(const float* testData, int* predictedLabels, int dataCount) const
+{
+    QuantizedWorkspace workspace(*this);
+    Predict(testData, predictedLabels, dataCount, workspace);
+}
+
+void QuantizedModel::ExecuteTestParallel(const float* testData, int* predictedLabels, int dataCount) const
+{
+    ThreadPool& pool = DefaultThreadPool();
+    int workers = pool.ThreadCount();
+
+    QuantizedWorkspace* workspaces = new QuantizedWorkspace[workers];
+    pool.ParallelFor(dataCount, PARALLEL_GRAIN, [&](int begin, int end, int worker) {
+        Predict(testData + (size_t)begin * inputDimension, predictedLabels + begin, end - begin, workspaces[worker]);
+    });
+    delete[] workspaces;
+}
+
+QuantizationReport QuantizedModel::Compare(const NeuralModel& model, const float* testData, const int* labels, int dataCount) const
+{
+    int* floatLabels = new int[dataCount];
+    int* quantizedLabels = new int[dataCount];
+    model.ExecuteTestParallel(testData, floatLabels, dataCount);
+    ExecuteTestParallel(testData, quantizedLabels, dataCount);
+
+    QuantizationReport report;
+    report.sampleCount = dataCount;
+    report.agreement = 0;
+    report.floatCorrect = (labels != nullptr) ? 0 : -1;
+    report.quantizedCorrect = (labels != nullptr) ? 0 : -1;
+    for (int i = 0; i < dataCount; i++)
+    {
+        if (floatLabels[i] == quantizedLabels[i])
+            report.agreement++;
+        if (labels != nullptr)
+        {
+            report.floatCorrect += (floatLabels[i] == labels[i]);
+            report.quantizedCorrect += (quantizedLabels[i] == labels[i]);
+        }
+    }
+    delete[] floatLabels;
+    delete[] quantizedLabels;
+    return report;
+}
+
+QuantizedWorkspace::QuantizedWorkspace()
+{
+    inputs = nullptr;
+    inputSize = 0;
+    dots = nullptr;
+    sums = nullptr;
+    sumSize = 0;
+}
+
+QuantizedWorkspace::QuantizedWorkspace(const QuantizedModel& model)
+{
+    inputs = nullptr;
+    inputSize = 0;
+    dots = nullptr;
+    sums = nullptr;
+    sumSize = 0;
+    Reserve(model);
+}
+
+QuantizedWorkspace::~QuantizedWorkspace()
+{
+    delete[] inputs;
+    delete[] dots;
+    delete[] sums;
+}
+
+void QuantizedWorkspace::Reserve(const QuantizedModel& model)
+{
+    if (model.inputTotal > inputSize)
+    {
+        delete[] inputs;
+        inputs = new signed char[model.inputTotal];
+        inputSize = model.inputTotal;
+    }
+    if (model.maxUnits > sumSize)
+    {
+        delete[] dots;
+        delete[] sums;
+        dots = new int[model.maxUnits];
+        sums = new float[model.maxUnits];
+        sumSize = model.maxUnits;
+    }
+    // Layers only write their first FanIn bytes; the padding must read as zero
+    memset(inputs, 0, inputSize);
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+
+class NeuralModel;
+class QuantizedModel;
+
+// Per-call scratch for QuantizedModel::Predict, one per thread like
+// InferenceWorkspace
+class QuantizedWorkspace
+{
+public:
+    QuantizedWorkspace();
+    explicit QuantizedWorkspace(const QuantizedModel& model);
+    ~QuantizedWorkspace();
+    // Grows the buffers to fit the model's shape and clears the padding
+    void Reserve(const QuantizedModel& model);
+private:
+    friend class QuantizedModel;
+    signed char* inputs;    // int8 input row of every layer, padded
+    size_t inputSize;
+    int* dots;              // integer sums of one layer
+    float* sums;            // pre-activations of one layer
+    int sumSize;
+    QuantizedWorkspace(const QuantizedWorkspace&);
+    QuantizedWorkspace& operator=(const QuantizedWorkspace&);
+};
+
+// fp32 against int8 (or bf16 / fp16) predictions on the same samples
+struct QuantizationReport
+{
+    int sampleCount;
+    int agreement;          // samples both paths assign the same class
+    int floatCorrect;       // matches with the labels, -1 without labels
+    int quantizedCorrect;
+};
+
+// Post-training int8 copy of a NeuralModel for batch prediction. Weights
+// are stored as int8 with one scale per row; every layer's input is
+// quantized to int8 so a layer is one integer matrix-vector product
+// (g_kernels.gemvInt8) plus one multiply-add per unit back to float. tanh
+// and the argmax stay in float.
+class QuantizedModel
+{
+public:
+    QuantizedModel();
+    ~QuantizedModel();
+    // Builds the int8 weights of model. calibrationData (raw features, as
+    // NeuralModel::Predict takes them) sets the activation ranges: each
+    // input feature gets its own offset and scale over the calibrated
+    // range, folded into the first layer's weights and offsets; hidden
+    // activations use one scale per layer. Inputs outside the calibrated
+    // range are clamped. Returns false for an empty model or no samples.
+    bool Quantize(const NeuralModel& model, const float* calibrationData, int calibrationCount);
+    bool IsQuantized() const { return weights != nullptr; }
+
+    void Predict(const float* testData, int* predictedLabels, int dataCount, QuantizedWorkspace& workspace) const;
+    void ExecuteTest(const float* testData, int* predictedLabels, int dataCount) const;
+    void ExecuteTestParallel(const float* testData, int* predictedLabels, int dataCount) const;
+
+    // Runs model.ExecuteTestParallel and this model on the same samples;
+    // labels may be null
+    QuantizationReport Compare(const NeuralModel& model, const float* testData, const int* labels, int dataCount) const;
+
+    int LayerCount() const { return layerTotal; }
+    int UnitCount(int layer) const { return unitCounts[layer]; }
+    int InputDimension() const { return inputDimension; }
+    int ClassCount() const { return unitCounts[layerTotal - 1]; }
+private:
+    friend class QuantizedWorkspace;
+    void release();
+    int classifySample(const float* input, QuantizedWorkspace& ws) const;
+
+    signed char* weights;       // row-major int8 rows of rowStride[l] bytes, zero padded
+    size_t* weightOffset;       // start of layer l in weights
+    int* rowStride;             // FanIn(l) rounded up to KERNEL_INT8_BLOCK
+    size_t* inputOffset;        // start of layer l's input row in a workspace
+    size_t inputTotal;
+    int* rowSums;               // per unit: sum of its int8 weights
+    float* rowScale;            // per unit: int32 sum -> float
+    float* offsets;             // per unit, input offsets folded in
+    int* unitOffset;            // units in the layers before l
+    float* inputCenter;         // first layer: x_q = (x - center) * inputInverseScale
+    float* inputInverseScale;
+    float* activationInverseScale; // layer l >= 1: a_q = a * activationInverseScale[l]
+    int* unitCounts;
+    int layerTotal;
+    int inputDimension;
+    int maxUnits;
+    QuantizedModel(const QuantizedModel&);
+    QuantizedModel& operator=(const QuantizedModel&);
+};
@@ -0,0 +1,69 @@
+#include "pch.h"
+#include "StaticNetwork.h"
+#include "ThreadPool.h"
+
+// Input dimension of every shape CreateStaticClassifier instantiates
+#define STATIC_INPUT 2
+
+void StaticClassifier::ExecuteTestParallel(const float* testData, int* predictedLabels, int dataCount) const
+{
+    int dimension = InputDimension();
+    DefaultThreadPool().ParallelFor(dataCount, PARALLEL_GRAIN, [&](int begin, int end, int) {
+        Predict(testData + (size_t)begin * dimension, predictedLabels + begin, end - begin);
+    });
+}
+
+template <int... Units>
+static StaticClassifier* createStatic(const NeuralModel& model)
+{
+    if (!StaticNetwork<STATIC_INPUT, Units...>::Matches(model))
+        return nullptr;
+    StaticNetwork<STATIC_INPUT, Units...>* network = new StaticNetwork<STATIC_INPUT, Units...>();
+    network->LoadFrom(model);
+    return network;
+}
+
+// One hidden shape with every class count the UI offers
+template <int... Hidden>
+static StaticClassifier* createForClasses(const NeuralModel& model)
+{
+    switch (model.ClassCount())
+    {
+    case 2: return createStatic<Hidden..., 2>(model);
+    case 3: return createStatic<Hidden..., 3>(model);
+    case 4: return createStatic<Hidden..., 4>(model);
+    case 5: return createStatic<Hidden..., 5>(model);
+    case 6: return createStatic<Hidden..., 6>(model);
+    case 7: return createStatic<Hidden..., 7>(model);
+    default: return nullptr;
+    }
+}
+
+StaticClassifier* CreateStaticClassifier(const NeuralModel& model)
+{
+    if (model.Parameters() == nullptr || model.InputDimension() != STATIC_INPUT)
+        return nullptr;
+    StaticClassifier* classifier = nullptr;
+    switch (model.LayerCount() - 1)
+    {
+    case 1:
+        classifier = createForClasses<4>(model);
+        if (classifier == nullptr)
+            classifier = createForClasses<8>(model);
+        if (classifier == nullptr)
+            classifier = createForClasses<16>(model);
+        break;
+    case 2:
+        classifier = createForClasses<4, 4>(model);
+        if (classifier == nullptr)
+            classifier = createForClasses<8, 8>(model);
+        if (classifier == nullptr)
+            classifier = createForClasses<16, 16>(model);
+        break;
+    case 3:
+        classifier = createForClasses<4, 4, 4>(model);
+        break;
+    default: break;
+    }
+    return classifier;
+}
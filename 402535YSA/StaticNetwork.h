@@ -0,0 +1,199 @@
+#pragma once
+#include "NeuralNetwork.h"
+#include "Kernels.h"
+#include <utility>
+
+// Inference for small fixed topologies with every layer size known at
+// compile time. Weights are stored input-major inside the object, so each
+// layer is FanIn fixed-length multiply-adds over its units that the
+// compiler unrolls and vectorizes, and activations live in stack arrays.
+// The output layer skips tanh (the argmax is the same), so labels match
+// NeuralModel::Predict except for sums within a few roundings of a
+// decision boundary or saturated outputs that tie there.
+
+// Hidden layers this wide activate through g_kernels.tanh, whose vector
+// code outweighs the indirect call; narrower ones inline TanhRational (or
+// tanh() in the exact activation mode)
+#define STATIC_KERNEL_UNITS 8
+
+// Runtime interface of every StaticNetwork, for callers that pick a
+// specialization by the model's shape (CreateStaticClassifier)
+class StaticClassifier
+{
+public:
+    virtual ~StaticClassifier() {}
+    virtual void Predict(const float* testData, int* predictedLabels, int dataCount) const = 0;
+    virtual int InputDimension() const = 0;
+    // Predict over DefaultThreadPool(); needs no workspaces
+    void ExecuteTestParallel(const float* testData, int* predictedLabels, int dataCount) const;
+};
+
+// One layer of UnitCount units over FanIn inputs
+template <int FanIn, int UnitCount>
+struct StaticLayer
+{
+    alignas(32) float weights[FanIn][UnitCount];   // weights[k][j] = W(j, k)
+    alignas(32) float offsets[UnitCount];
+
+    void load(const NeuralModel& model, int layer)
+    {
+        const float* w = model.Weights(layer);
+        for (int j = 0; j < UnitCount; j++)
+            for (int k = 0; k < FanIn; k++)
+                weights[k][j] = w[j * FanIn + k];
+        for (int j = 0; j < UnitCount; j++)
+            offsets[j] = model.Offsets(layer)[j];
+    }
+
+    // Sums in input order, then the offset, like the scalar dot kernel.
+    // One unit loop per input, expanded at compile time: with the input
+    // loop left in place GCC -O3 vectorizes across inputs instead, which
+    // needs a transpose per layer.
+    void forward(const float* input, float* out) const
+    {
+        alignas(32) float sums[UnitCount] = {};
+        accumulate(input, sums, std::make_integer_sequence<int, FanIn>());
+        for (int j = 0; j < UnitCount; j++)
+            out[j] = sums[j] + offsets[j];
+    }
+
+    template <int... K>
+    void accumulate(const float* input, float* sums, std::integer_sequence<int, K...>) const
+    {
+        int expand[] = { (addInput(weights[K], input[K], sums), 0)... };
+        (void)expand;
+    }
+
+    static void addInput(const float* w, float x, float* sums)
+    {
+        for (int j = 0; j < UnitCount; j++)
+            sums[j] += w[j] * x;
+    }
+};
+
+// Chain of layers: FanIn inputs, then one unit count per layer
+template <int FanIn, int... Units>
+struct StaticLayers;
+
+template <int FanIn, int UnitCount, int NextUnits, int... Rest>
+struct StaticLayers<FanIn, UnitCount, NextUnits, Rest...>
+{
+    StaticLayer<FanIn, UnitCount> layer;
+    StaticLayers<UnitCount, NextUnits, Rest...> next;
+
+    void load(const NeuralModel& model, int index)
+    {
+        layer.load(model, index);
+        next.load(model, index + 1);
+    }
+
+    template <bool Exact>
+    int classify(const float* input) const
+    {
+        alignas(32) float acts[UnitCount];
+        layer.forward(input, acts);
+        if (UnitCount >= STATIC_KERNEL_UNITS)
+            g_kernels.tanh(acts, UnitCount);
+        else
+        {
+            for (int j = 0; j < UnitCount; j++)
+                acts[j] = Exact ? (float)tanh(acts[j]) : TanhRational(acts[j]);
+        }
+        return next.template classify<Exact>(acts);
+    }
+};
+
+// Output layer: argmax of the sums
+template <int FanIn, int Classes>
+struct StaticLayers<FanIn, Classes>
+{
+    StaticLayer<FanIn, Classes> layer;
+
+    void load(const NeuralModel& model, int index)
+    {
+        layer.load(model, index);
+    }
+
+    template <bool Exact>
+    int classify(const float* input) const
+    {
+        alignas(32) float sums[Classes];
+        layer.forward(input, sums);
+        int maxIndex = 0;
+        for (int j = 1; j < Classes; j++)
+            if (sums[j] > sums[maxIndex])
+                maxIndex = j;
+        return maxIndex;
+    }
+};
+
+// StaticNetwork<2, 4, 4, 3>: 2 inputs, hidden layers of 4 and 4 units, 3
+// classes. Construct it empty and fill it with LoadFrom or LoadWeights.
+template <int Input, int... Units>
+class StaticNetwork : public StaticClassifier
+{
+public:
+    static_assert(sizeof...(Units) >= 1, "StaticNetwork needs at least the output layer");
+    static const int LAYERS = sizeof...(Units);
+
+    // true if model has exactly this shape
+    static bool Matches(const NeuralModel& model)
+    {
+        const int units[] = { Units... };
+        if (model.Parameters() == nullptr || model.InputDimension() != Input || model.LayerCount() != LAYERS)
+            return false;
+        for (int l = 0; l < LAYERS; l++)
+            if (model.UnitCount(l) != units[l])
+                return false;
+        return true;
+    }
+
+    // Copies the (folded) parameters of model; false if the shape differs
+    bool LoadFrom(const NeuralModel& model)
+    {
+        if (!Matches(model))
+            return false;
+        layers.load(model, 0);
+        return true;
+    }
+
+    // Weight file as NeuralModel::SaveWeights writes it
+    bool LoadWeights(const char* path)
+    {
+        NeuralModel model;
+        return model.MapWeights(path) && LoadFrom(model);
+    }
+
+    int Classify(const float* input) const
+    {
+        if (CurrentActivationAccuracy() == ACTIVATION_EXACT)
+            return layers.template classify<true>(input);
+        return layers.template classify<false>(input);
+    }
+
+    // The activation mode is read once per call; each mode gets its own
+    // loop so the fast one has no branch left inside
+    void Predict(const float* testData, int* predictedLabels, int dataCount) const
+    {
+        if (CurrentActivationAccuracy() == ACTIVATION_EXACT)
+        {
+            for (int sample = 0; sample < dataCount; sample++)
+                predictedLabels[sample] = layers.template classify<true>(testData + (size_t)sample * Input);
+        }
+        else
+        {
+            for (int sample = 0; sample < dataCount; sample++)
+                predictedLabels[sample] = layers.template classify<false>(testData + (size_t)sample * Input);
+        }
+    }
+
+    int InputDimension() const { return Input; }
+private:
+    StaticLayers<Input, Units...> layers;
+};
+
+// A StaticNetwork for model if its shape is one of the instantiated ones
+// (2 inputs; hidden layers 4, 8, 16, 4-4, 8-8, 16-16 or 4-4-4; 2 to 7
+// classes), loaded with its parameters. Null otherwise; the caller deletes
+// the result.
+StaticClassifier* CreateStaticClassifier(const NeuralModel& model);
@@ -0,0 +1,36 @@
+#include "pch.h"
+#include "Telemetry.h"
+
+TrainingHistory::TrainingHistory()
+{
+    count = 0;
+    stride = 1;
+}
+
+void TrainingHistory::Clear()
+{
+    count = 0;
+    stride = 1;
+}
+
+void TrainingHistory::Add(int epoch, float value)
+{
+    if (epoch % stride != 0)
+        return;
+    if (count == TRAINING_HISTORY_POINTS)
+    {
+        // Points sit at multiples of stride; keep the multiples of 2 * stride
+        for (int i = 0; 2 * i < count; i++)
+        {
+            epochs[i] = epochs[2 * i];
+            values[i] = values[2 * i];
+        }
+        count = (count + 1) / 2;
+        stride *= 2;
+        if (epoch % stride != 0)
+            return;
+    }
+    epochs[count] = epoch;
+    values[count] = value;
+    count++;
+}
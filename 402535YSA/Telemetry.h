@@ -0,0 +1,56 @@
+#pragma once
+
+// Points kept by a TrainingHistory
+#define TRAINING_HISTORY_POINTS 1024
+// Default TrainingConfig::reportInterval, in epochs
+#define TELEMETRY_INTERVAL 10
+
+// One progress report of NeuralModel::Train
+struct EpochTelemetry
+{
+    int epoch;                  // index of the epoch just finished
+    float trainError;           // training RMSE of that epoch
+    float validationError;      // -1 without a validation split
+    float learningRate;         // scheduled rate of that epoch
+    double elapsedSeconds;      // since Train started
+    double samplesPerSecond;    // training samples over the epochs since the previous report
+    // Per layer (LayerCount() entries) nanoseconds spent in the forward
+    // pass, back-propagation and optimizer step since the previous report,
+    // summed over the workers. Null unless TrainingConfig::timeLayers.
+    int layerCount;
+    const long long* forwardNanos;
+    const long long* backwardNanos;
+    const long long* updateNanos;
+};
+
+// Receives reports on the training thread every reportInterval epochs and
+// after the last epoch. Reports run between epochs, so a slow receiver
+// slows training down but never sees a half updated model.
+class TrainingTelemetry
+{
+public:
+    virtual ~TrainingTelemetry() {}
+    virtual void OnReport(const EpochTelemetry& report) = 0;
+};
+
+// Error curve of a training run in fixed memory. Points are kept every
+// Stride() epochs; when all TRAINING_HISTORY_POINTS are used every other
+// point is dropped and the stride doubles, so a run of any length keeps
+// between half and all of the points, evenly spread over it.
+class TrainingHistory
+{
+public:
+    TrainingHistory();
+    void Clear();
+    // Epochs must arrive in order starting from 0
+    void Add(int epoch, float value);
+    int Count() const { return count; }
+    int Epoch(int i) const { return epochs[i]; }
+    float Value(int i) const { return values[i]; }
+    int Stride() const { return stride; }
+private:
+    int epochs[TRAINING_HISTORY_POINTS];
+    float values[TRAINING_HISTORY_POINTS];
+    int count;
+    int stride;
+};
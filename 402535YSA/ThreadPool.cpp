@@ -0,0 +1,133 @@
+#include "pch.h"
+#include "ThreadPool.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+struct ThreadPool::Impl
+{
+    std::vector<std::thread> threads;
+    std::mutex callLock;                 // one ParallelFor at a time
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const std::function<void(int, int, int)>* task = nullptr;
+    int count = 0;
+    int chunk = 1;
+    std::atomic<int> next{ 0 };
+    int busy = 0;                        // background workers still running the job
+    unsigned long long generation = 0;
+    bool stopping = false;
+
+    void RunChunks(int worker)
+    {
+        for (;;)
+        {
+            int begin = next.fetch_add(chunk);
+            if (begin >= count)
+                break;
+            int end = (begin + chunk < count) ? begin + chunk : count;
+            (*task)(begin, end, worker);
+        }
+    }
+
+    void WorkerLoop(int worker)
+    {
+        unsigned long long seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            RunChunks(worker);
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (--busy == 0)
+                    done.notify_one();
+            }
+        }
+    }
+};
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    impl = new Impl;
+    if (threadCount <= 0)
+        threadCount = (int)std::thread::hardware_concurrency();
+    if (threadCount <= 0)
+        threadCount = 1;
+
+    // The calling thread acts as worker 0
+    for (int w = 1; w < threadCount; w++)
+        impl->threads.emplace_back(&Impl::WorkerLoop, impl, w);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(impl->lock);
+        impl->stopping = true;
+    }
+    impl->wake.notify_all();
+    for (size_t i = 0; i < impl->threads.size(); i++)
+        impl->threads[i].join();
+    delete impl;
+}
+
+int ThreadPool::ThreadCount() const
+{
+    return (int)impl->threads.size() + 1;
+}
+
+void ThreadPool::ParallelFor(int count, int grainSize, const std::function<void(int begin, int end, int worker)>& task)
+{
+    if (count <= 0)
+        return;
+    if (grainSize < 1)
+        grainSize = 1;
+
+    int workers = ThreadCount();
+    if (workers == 1 || count <= grainSize)
+    {
+        task(0, count, 0);
+        return;
+    }
+
+    std::lock_guard<std::mutex> call(impl->callLock);
+
+    // A few chunks per worker keeps the load balanced without contention
+    int chunk = count / (workers * 4);
+    if (chunk < grainSize)
+        chunk = grainSize;
+
+    {
+        std::lock_guard<std::mutex> guard(impl->lock);
+        impl->task = &task;
+        impl->count = count;
+        impl->chunk = chunk;
+        impl->next.store(0);
+        impl->busy = (int)impl->threads.size();
+        impl->generation++;
+    }
+    impl->wake.notify_all();
+
+    impl->RunChunks(0);
+
+    std::unique_lock<std::mutex> guard(impl->lock);
+    impl->done.wait(guard, [&] { return impl->busy == 0; });
+    impl->task = nullptr;
+}
+
+ThreadPool& DefaultThreadPool()
+{
+    // Never destroyed: joining workers during process shutdown is not safe
+    // in a mixed-mode executable.
+    static ThreadPool* pool = new ThreadPool();
+    return *pool;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <functional>
+
+// Fixed-size pool of worker threads. The header deliberately avoids
+// <thread>/<mutex> so it can be included from /clr translation units.
+class ThreadPool
+{
+public:
+    // threadCount <= 0 uses one worker per hardware thread
+    explicit ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+
+    // Number of workers, including the thread that calls ParallelFor
+    int ThreadCount() const;
+
+    // Splits [0, count) into chunks of at least grainSize items and calls
+    // task(begin, end, worker) for each of them, where worker is in
+    // [0, ThreadCount()) and no two chunks with the same worker index run
+    // at the same time. Returns when every chunk has finished.
+    void ParallelFor(int count, int grainSize, const std::function<void(int begin, int end, int worker)>& task);
+
+private:
+    struct Impl;
+    Impl* impl;
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+};
+
+// Process-wide pool sized to the machine, created on first use
+ThreadPool& DefaultThreadPool();
@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "TrainingConfig.h"
+#include "NeuralNetwork.h"
+#include <chrono>
+#include <math.h>
+
+#define TRAINING_PI 3.14159265358979323846
+
+TrainingConfig::TrainingConfig()
+{
+    maxEpochs = CYCLE_MAX;
+    targetError = (float)EMAX;
+    batchSize = 1;
+    parallelism = TRAIN_SERIAL;
+    pool = nullptr;
+
+    validationFraction = 0;
+    shuffleSeed = 1;
+    validationData = nullptr;
+    validationLabels = nullptr;
+    validationCount = 0;
+
+    patience = 0;
+    minImprovement = 0;
+    restoreBest = true;
+
+    schedule = LR_CONSTANT;
+    stepEpochs = 1000;
+    decay = 0.5f;
+    plateauPatience = 100;
+    minLearningRate = 0;
+
+    timeBudgetSeconds = 0;
+    resetOptimizer = true;
+
+    telemetry = nullptr;
+    reportInterval = TELEMETRY_INTERVAL;
+    timeLayers = false;
+
+    weightPrecision = PRECISION_FP32;
+
+    cancel = nullptr;
+    snapshots = nullptr;
+    snapshotInterval = SNAPSHOT_INTERVAL;
+}
+
+IncrementalConfig::IncrementalConfig()
+{
+    resetOptimizer = false;
+    newSampleWeight = 4;
+    replayCount = 256;
+}
+
+float ScheduledLearningRate(const TrainingConfig& config, float baseRate, float currentRate, int epoch)
+{
+    switch (config.schedule)
+    {
+    case LR_STEP:
+    {
+        int steps = (config.stepEpochs > 0) ? epoch / config.stepEpochs : 0;
+        float rate = baseRate * (float)pow((double)config.decay, (double)steps);
+        return (rate > config.minLearningRate) ? rate : config.minLearningRate;
+    }
+    case LR_COSINE:
+    {
+        double progress = (config.maxEpochs > 1) ? (double)epoch / (config.maxEpochs - 1) : 1.0;
+        return config.minLearningRate
+            + 0.5f * (baseRate - config.minLearningRate) * (float)(1 + cos(TRAINING_PI * progress));
+    }
+    case LR_PLATEAU:
+        return currentRate;
+    default:
+        return baseRate;
+    }
+}
+
+double MonotonicSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+class ThreadPool;
+class TrainingTelemetry;
+class CancellationToken;
+class TrainingSnapshots;
+
+enum TrainingParallelism
+{
+    TRAIN_SERIAL = 0,
+    // Every batch is split into one shard per worker; shard gradients go to
+    // separate buffers and are summed in shard order before one optimizer
+    // step, so a run is reproducible for a given thread count.
+    TRAIN_SYNC,
+    // Workers take disjoint ranges of batches and step the shared parameters
+    // without locks (Hogwild). Fastest, but not reproducible.
+    TRAIN_HOGWILD
+};
+
+enum LearningRateSchedule
+{
+    LR_CONSTANT = 0,
+    LR_STEP,        // lr * decay every stepEpochs epochs
+    LR_COSINE,      // cosine from lr down to minLearningRate over maxEpochs
+    LR_PLATEAU      // lr * decay after plateauPatience epochs without improvement
+};
+
+enum TrainingStopReason
+{
+    STOP_TARGET_ERROR = 0,  // monitored RMSE fell below targetError
+    STOP_MAX_EPOCHS,
+    STOP_NO_IMPROVEMENT,    // patience ran out
+    STOP_TIME_BUDGET,
+    STOP_CANCELLED          // TrainingConfig::cancel was set
+};
+
+// Storage format of weights: HalfPrecisionModel for inference, and the
+// rounding TrainingConfig::weightPrecision applies while training
+enum WeightPrecision
+{
+    PRECISION_FP32 = 0,
+    PRECISION_BF16,     // 8 bit exponent, 7 bit mantissa: fp32 range
+    PRECISION_FP16      // IEEE half: 5 bit exponent, 10 bit mantissa, |x| <= 65504
+};
+
+// Everything NeuralModel::Train needs besides data and optimizer. The
+// defaults reproduce the fixed EMAX / CYCLE_MAX loop.
+struct TrainingConfig
+{
+    TrainingConfig();
+
+    int maxEpochs;
+    float targetError;          // stop once the monitored RMSE is below this
+    int batchSize;
+    TrainingParallelism parallelism;
+    ThreadPool* pool;           // DefaultThreadPool() if null
+
+    // Held-out validation split: the given fraction of the samples, picked
+    // by a shuffle with shuffleSeed. When set, early stopping, the plateau
+    // schedule and targetError look at the validation RMSE.
+    float validationFraction;
+    unsigned int shuffleSeed;
+    // Held-out rows of their own, used instead of a split. They are only
+    // read, so one copy can serve any number of concurrent Train calls.
+    const float* validationData;
+    const int* validationLabels;
+    int validationCount;
+
+    // Early stopping: stop after patience epochs in which the monitored RMSE
+    // did not improve by more than minImprovement (0 disables)
+    int patience;
+    float minImprovement;
+    bool restoreBest;           // roll back to the best epoch's parameters
+
+    LearningRateSchedule schedule;
+    int stepEpochs;
+    float decay;
+    int plateauPatience;
+    float minLearningRate;
+
+    double timeBudgetSeconds;   // wall clock limit, 0 = none
+
+    // false continues with the optimizer's current state (moments,
+    // velocities, step count) if it was initialized for this model's shape
+    bool resetOptimizer;
+
+    // Progress reports (Telemetry.h) every reportInterval epochs, none if
+    // telemetry is null. timeLayers adds per-layer phase timers, which cost
+    // clock reads per layer and batch.
+    TrainingTelemetry* telemetry;
+    int reportInterval;
+    bool timeLayers;
+
+    // Mixed precision: bf16 / fp16 train on weights rounded to that format
+    // after every step while the optimizer updates an fp32 master copy,
+    // which is what the model holds when Train returns
+    WeightPrecision weightPrecision;
+
+    // Background training (TrainingJob.h). cancel is polled after every
+    // epoch and stops like the other rules do. snapshots receives a copy
+    // of the parameters, folded as Train would leave them, after the first
+    // epoch and every snapshotInterval epochs.
+    const CancellationToken* cancel;
+    TrainingSnapshots* snapshots;
+    int snapshotInterval;
+};
+
+// NeuralModel::TrainIncremental: new samples are repeated newSampleWeight
+// times and mixed with at most replayCount old samples drawn at random, so
+// a warm start only revisits a bounded part of what the model already knows
+struct IncrementalConfig : public TrainingConfig
+{
+    IncrementalConfig();
+
+    int newSampleWeight;
+    int replayCount;
+};
+
+struct TrainingResult
+{
+    TrainingStopReason reason;
+    int lastEpoch;              // index of the last epoch run, -1 if there were no samples
+    int bestEpoch;              // epoch with the lowest monitored RMSE
+    float trainError;           // training RMSE of the last epoch
+    float validationError;      // validation RMSE of the last epoch, -1 without a split
+    float bestError;
+};
+
+// Learning rate for epoch under a step or cosine schedule; the plateau
+// schedule is driven by the training loop and returns the current rate.
+float ScheduledLearningRate(const TrainingConfig& config, float baseRate, float currentRate, int epoch);
+
+// Seconds on a monotonic clock
+double MonotonicSeconds();
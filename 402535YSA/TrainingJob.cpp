@@ -0,0 +1,253 @@
+#include "pch.h"
+#include "TrainingJob.h"
+#include "NeuralNetwork.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+
+struct CancellationToken::Impl
+{
+    std::atomic<bool> cancelled{ false };
+};
+
+CancellationToken::CancellationToken()
+{
+    impl = new Impl;
+}
+
+CancellationToken::~CancellationToken()
+{
+    delete impl;
+}
+
+void CancellationToken::Cancel()
+{
+    impl->cancelled.store(true);
+}
+
+void CancellationToken::Reset()
+{
+    impl->cancelled.store(false);
+}
+
+bool CancellationToken::IsCancelled() const
+{
+    return impl->cancelled.load();
+}
+
+struct TrainingSnapshots::Impl
+{
+    mutable std::mutex lock;
+    NeuralModel buffers[2];
+    int front = 0;              // buffers[front] is the latest, buffers[1 - front] the back buffer
+    bool published = false;
+    int epoch = -1;
+    int version = 0;
+};
+
+TrainingSnapshots::TrainingSnapshots()
+{
+    impl = new Impl;
+}
+
+TrainingSnapshots::~TrainingSnapshots()
+{
+    delete impl;
+}
+
+bool TrainingSnapshots::CopyLatest(NeuralModel& out, int* epoch) const
+{
+    std::lock_guard<std::mutex> guard(impl->lock);
+    if (!impl->published)
+        return false;
+    const NeuralModel& latest = impl->buffers[impl->front];
+    if (!out.CopyParametersFrom(latest))
+        out = latest;
+    if (epoch != nullptr)
+        *epoch = impl->epoch;
+    return true;
+}
+
+int TrainingSnapshots::Version() const
+{
+    std::lock_guard<std::mutex> guard(impl->lock);
+    return impl->version;
+}
+
+void TrainingSnapshots::Publish(const NeuralModel& model, int epoch)
+{
+    NeuralModel& snapshot = backBuffer();
+    if (!snapshot.CopyParametersFrom(model))
+        snapshot = model;
+    swapBuffers(epoch);
+}
+
+void TrainingSnapshots::Clear()
+{
+    // The version keeps counting so pollers still notice the next publish
+    std::lock_guard<std::mutex> guard(impl->lock);
+    impl->published = false;
+    impl->epoch = -1;
+}
+
+NeuralModel& TrainingSnapshots::backBuffer()
+{
+    // Readers only touch the front buffer, and only under the lock
+    return impl->buffers[1 - impl->front];
+}
+
+void TrainingSnapshots::swapBuffers(int epoch)
+{
+    std::lock_guard<std::mutex> guard(impl->lock);
+    impl->front = 1 - impl->front;
+    impl->published = true;
+    impl->epoch = epoch;
+    impl->version++;
+}
+
+// The job's own telemetry receiver: records progress, then forwards
+struct TrainingJob::Impl : public TrainingTelemetry
+{
+    std::thread thread;
+    mutable std::mutex lock;
+    std::atomic<bool> running{ false };
+    CancellationToken cancel;
+    TrainingTelemetry* forward = nullptr;
+    TrainingProgress progress;
+    TrainingResult result;
+
+    // The job's copy of the samples
+    float* data = nullptr;
+    int* labels = nullptr;
+
+    void OnReport(const EpochTelemetry& report)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            progress.epoch = report.epoch;
+            progress.trainError = report.trainError;
+            progress.validationError = report.validationError;
+            progress.elapsedSeconds = report.elapsedSeconds;
+        }
+        if (forward != nullptr)
+            forward->OnReport(report);
+    }
+
+    void releaseSamples()
+    {
+        delete[] data;
+        delete[] labels;
+        data = nullptr;
+        labels = nullptr;
+    }
+};
+
+TrainingJob::TrainingJob()
+{
+    impl = new Impl;
+    impl->progress.running = false;
+    impl->progress.epoch = -1;
+    impl->progress.trainError = 0;
+    impl->progress.validationError = -1;
+    impl->progress.elapsedSeconds = 0;
+    impl->progress.snapshotVersion = 0;
+    impl->result.reason = STOP_MAX_EPOCHS;
+    impl->result.lastEpoch = 0;
+    impl->result.bestEpoch = 0;
+    impl->result.trainError = 0;
+    impl->result.validationError = -1;
+    impl->result.bestError = 0;
+}
+
+TrainingJob::~TrainingJob()
+{
+    Cancel();
+    Wait();
+    impl->releaseSamples();
+    delete impl;
+}
+
+bool TrainingJob::Start(NeuralModel& model, Optimizer& optimizer, const float* trainingData, const int* targetLabels,
+    int sampleCount, const TrainingConfig& config)
+{
+    IncrementalConfig incremental;
+    static_cast<TrainingConfig&>(incremental) = config;
+    return StartIncremental(model, optimizer, trainingData, targetLabels, sampleCount, 0, incremental);
+}
+
+bool TrainingJob::StartIncremental(NeuralModel& model, Optimizer& optimizer, const float* trainingData, const int* targetLabels,
+    int sampleCount, int firstNewSample, const IncrementalConfig& config)
+{
+    if (impl->running.load() || sampleCount < 1)
+        return false;
+    if (impl->thread.joinable())
+        impl->thread.join();
+
+    impl->releaseSamples();
+    impl->data = new float[(size_t)sampleCount * model.InputDimension()];
+    impl->labels = new int[sampleCount];
+    memcpy(impl->data, trainingData, (size_t)sampleCount * model.InputDimension() * sizeof(float));
+    memcpy(impl->labels, targetLabels, sampleCount * sizeof(int));
+
+    IncrementalConfig jobConfig = config;
+    impl->forward = config.telemetry;
+    jobConfig.telemetry = impl;
+    jobConfig.cancel = &impl->cancel;
+    jobConfig.snapshots = &snapshots;
+
+    impl->cancel.Reset();
+    snapshots.Clear();
+    {
+        std::lock_guard<std::mutex> guard(impl->lock);
+        impl->progress.epoch = -1;
+        impl->progress.trainError = 0;
+        impl->progress.validationError = -1;
+        impl->progress.elapsedSeconds = 0;
+    }
+    impl->running.store(true);
+
+    Impl* job = impl;
+    NeuralModel* target = &model;
+    Optimizer* steps = &optimizer;
+    impl->thread = std::thread([job, target, steps, sampleCount, firstNewSample, jobConfig]() {
+        TrainingResult result = target->TrainIncremental(job->data, job->labels, sampleCount, firstNewSample,
+            *steps, jobConfig);
+        {
+            std::lock_guard<std::mutex> guard(job->lock);
+            job->result = result;
+        }
+        job->running.store(false);
+    });
+    return true;
+}
+
+void TrainingJob::Cancel()
+{
+    impl->cancel.Cancel();
+}
+
+bool TrainingJob::IsRunning() const
+{
+    return impl->running.load();
+}
+
+TrainingResult TrainingJob::Wait()
+{
+    if (impl->thread.joinable())
+        impl->thread.join();
+    std::lock_guard<std::mutex> guard(impl->lock);
+    return impl->result;
+}
+
+TrainingProgress TrainingJob::Progress() const
+{
+    TrainingProgress progress;
+    {
+        std::lock_guard<std::mutex> guard(impl->lock);
+        progress = impl->progress;
+    }
+    progress.running = impl->running.load();
+    progress.snapshotVersion = snapshots.Version();
+    return progress;
+}
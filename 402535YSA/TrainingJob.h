@@ -0,0 +1,103 @@
+#pragma once
+#include "TrainingConfig.h"
+#include "Telemetry.h"
+
+// Like ThreadPool.h, this header avoids <thread>/<mutex>/<atomic> so the
+// form can include it from /clr code.
+
+class NeuralModel;
+class Optimizer;
+
+// Flag polled by Train after every epoch (TrainingConfig::cancel); safe to
+// set from any thread
+class CancellationToken
+{
+public:
+    CancellationToken();
+    ~CancellationToken();
+    void Cancel();
+    void Reset();
+    bool IsCancelled() const;
+private:
+    struct Impl;
+    Impl* impl;
+    CancellationToken(const CancellationToken&);
+    CancellationToken& operator=(const CancellationToken&);
+};
+
+// Latest parameters of a running Train (TrainingConfig::snapshots). Train
+// fills a back buffer on its own thread and swaps it in under a lock, so a
+// reader copies either the previous snapshot or the new one, never a mix,
+// and training never waits for more than that swap.
+class TrainingSnapshots
+{
+public:
+    TrainingSnapshots();
+    ~TrainingSnapshots();
+    // Copies the latest snapshot into out (reshaping it if needed) and its
+    // epoch into epoch if not null. False if nothing was published yet.
+    bool CopyLatest(NeuralModel& out, int* epoch = nullptr) const;
+    // Publishes that happened so far; lets a poller skip unchanged snapshots
+    int Version() const;
+    // Publishes a finished (folded) model, e.g. the result of Train
+    void Publish(const NeuralModel& model, int epoch);
+    void Clear();
+private:
+    friend class NeuralModel;
+    // Buffer only the publishing thread touches, then made the latest
+    NeuralModel& backBuffer();
+    void swapBuffers(int epoch);
+
+    struct Impl;
+    Impl* impl;
+    TrainingSnapshots(const TrainingSnapshots&);
+    TrainingSnapshots& operator=(const TrainingSnapshots&);
+};
+
+// What a TrainingJob has done so far, as of its last progress report
+struct TrainingProgress
+{
+    bool running;
+    int epoch;                  // last reported epoch, -1 before the first
+    float trainError;
+    float validationError;      // -1 without a validation split
+    double elapsedSeconds;
+    int snapshotVersion;        // TrainingSnapshots::Version()
+};
+
+// Runs NeuralModel::Train / TrainIncremental on a worker thread. The job
+// trains on its own copy of the samples, so the caller may keep adding
+// points, but the model and optimizer belong to the job until Wait returns
+// (or IsRunning is false): read the snapshots instead. Progress reports
+// arrive every config.reportInterval epochs; config.telemetry, if set, is
+// still called with each of them, on the worker thread.
+class TrainingJob
+{
+public:
+    TrainingJob();
+    // Cancels a running job and waits for it
+    ~TrainingJob();
+
+    // False if a job is still running or there are no samples.
+    // config.cancel and config.snapshots are replaced by the job's own.
+    bool Start(NeuralModel& model, Optimizer& optimizer, const float* trainingData, const int* targetLabels,
+        int sampleCount, const TrainingConfig& config);
+    // Warm start, as NeuralModel::TrainIncremental
+    bool StartIncremental(NeuralModel& model, Optimizer& optimizer, const float* trainingData, const int* targetLabels,
+        int sampleCount, int firstNewSample, const IncrementalConfig& config);
+
+    // Asks Train to stop after the current epoch (STOP_CANCELLED)
+    void Cancel();
+    bool IsRunning() const;
+    // Blocks until the job has finished; result of the last job
+    TrainingResult Wait();
+
+    TrainingProgress Progress() const;
+    const TrainingSnapshots& Snapshots() const { return snapshots; }
+private:
+    struct Impl;
+    Impl* impl;
+    TrainingSnapshots snapshots;
+    TrainingJob(const TrainingJob&);
+    TrainingJob& operator=(const TrainingJob&);
+};
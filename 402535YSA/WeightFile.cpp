@@ -0,0 +1,169 @@
+#include "pch.h"
+#include "WeightFile.h"
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct CrcTable
+{
+    uint32_t entries[256];
+    CrcTable()
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+    }
+};
+
+// Built on first use; initialization of a function-local static is
+// thread-safe, so concurrent loads and saves never see a partial table
+static const uint32_t* crcTable()
+{
+    static const CrcTable table;
+    return table.entries;
+}
+
+uint32_t Crc32(const void* data, size_t size, uint32_t crc)
+{
+    const uint32_t* table = crcTable();
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void MakeWeightFileHeader(WeightFileHeader* header, int hiddenLayerCount, int inputDimension,
+    int classCount, size_t parameterCount)
+{
+    memset(header, 0, sizeof(WeightFileHeader));
+    memcpy(header->magic, WEIGHT_FILE_MAGIC, sizeof(WEIGHT_FILE_MAGIC));
+    header->version = WEIGHT_FILE_VERSION;
+    header->dtype = WEIGHT_DTYPE_FLOAT32;
+    header->headerSize = sizeof(WeightFileHeader);
+    header->hiddenLayerCount = hiddenLayerCount;
+    header->inputDimension = inputDimension;
+    header->classCount = classCount;
+    header->parameterCount = parameterCount;
+
+    size_t shapeEnd = sizeof(WeightFileHeader) + (size_t)hiddenLayerCount * sizeof(int32_t);
+    header->dataOffset = (shapeEnd + WEIGHT_FILE_ALIGNMENT - 1) & ~(size_t)(WEIGHT_FILE_ALIGNMENT - 1);
+}
+
+bool ValidateWeightFileHeader(const WeightFileHeader& header, uint64_t fileSize)
+{
+    if (memcmp(header.magic, WEIGHT_FILE_MAGIC, sizeof(WEIGHT_FILE_MAGIC)) != 0)
+        return false;
+    if (header.version != WEIGHT_FILE_VERSION || header.dtype != WEIGHT_DTYPE_FLOAT32
+        || header.headerSize != sizeof(WeightFileHeader))
+        return false;
+    if (header.hiddenLayerCount < 0 || header.hiddenLayerCount > WEIGHT_FILE_MAX_LAYERS
+        || header.inputDimension <= 0 || header.classCount <= 0)
+        return false;
+    if (header.dataOffset % WEIGHT_FILE_ALIGNMENT != 0
+        || header.dataOffset < sizeof(WeightFileHeader) + (uint64_t)header.hiddenLayerCount * sizeof(int32_t)
+        || header.dataOffset > fileSize)
+        return false;
+    // Written this way round so a huge parameterCount cannot overflow
+    if (header.parameterCount > (fileSize - header.dataOffset) / sizeof(float))
+        return false;
+    // Every output unit has an offset and the first layer a weight per input
+    if ((uint64_t)header.inputDimension > header.parameterCount || (uint64_t)header.classCount > header.parameterCount)
+        return false;
+    return true;
+}
+
+MappedFile::MappedFile()
+{
+    data = nullptr;
+    size = 0;
+#ifdef _WIN32
+    fileHandle = INVALID_HANDLE_VALUE;
+    mappingHandle = nullptr;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const char* path)
+{
+    Close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (view == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    data = static_cast<unsigned char*>(view);
+    size = (size_t)fileSize.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+        return false;
+    data = static_cast<unsigned char*>(view);
+    size = (size_t)info.st_size;
+#endif
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data == nullptr)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle((HANDLE)mappingHandle);
+    CloseHandle((HANDLE)fileHandle);
+    fileHandle = INVALID_HANDLE_VALUE;
+    mappingHandle = nullptr;
+#else
+    munmap(data, size);
+#endif
+    data = nullptr;
+    size = 0;
+}
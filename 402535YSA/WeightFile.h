@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Binary weight file, version 1 (little endian):
+//
+//   offset 0            WeightFileHeader (64 bytes)
+//   offset 64           hiddenLayerCount int32 unit counts
+//   offset dataOffset   the parameter arena exactly as NeuralModel lays it
+//                       out in memory: W0 b0 W1 b1 ..., every section on a
+//                       64 byte boundary, padding zero
+//
+// dataOffset is a multiple of 64, so a mapped file can be used as the
+// arena in place. checksum is the CRC-32 of the unit counts followed by
+// the parameterCount floats of the arena.
+#define WEIGHT_FILE_MAGIC "YSAWGHT"
+#define WEIGHT_FILE_VERSION 1
+#define WEIGHT_FILE_ALIGNMENT 64
+// Hidden layers a file may declare, far beyond any trainable shape; keeps
+// a corrupt count from sizing the shape table
+#define WEIGHT_FILE_MAX_LAYERS 4096
+
+enum WeightDataType
+{
+    WEIGHT_DTYPE_FLOAT32 = 0
+};
+
+struct WeightFileHeader
+{
+    char magic[8];              // WEIGHT_FILE_MAGIC, zero terminated
+    uint32_t version;           // WEIGHT_FILE_VERSION
+    uint32_t dtype;             // WeightDataType of the arena
+    uint32_t headerSize;        // sizeof(WeightFileHeader)
+    int32_t hiddenLayerCount;
+    int32_t inputDimension;
+    int32_t classCount;
+    uint64_t parameterCount;    // floats in the arena, padding included
+    uint64_t dataOffset;        // file offset of the arena
+    uint32_t checksum;
+    uint32_t reserved[3];
+};
+
+static_assert(sizeof(WeightFileHeader) == 64, "weight file header must stay 64 bytes");
+
+// CRC-32 (IEEE 802.3). Pass the previous result as crc to continue a sum.
+uint32_t Crc32(const void* data, size_t size, uint32_t crc = 0);
+
+// Fills header for the given shape; the checksum is left zero
+void MakeWeightFileHeader(WeightFileHeader* header, int hiddenLayerCount, int inputDimension,
+    int classCount, size_t parameterCount);
+
+// Checks magic, version, dtype and shape, and that the shape table and the
+// arena fit in a file of fileSize bytes, so nothing is allocated for a
+// truncated or corrupt file. Does not look at the payload.
+bool ValidateWeightFileHeader(const WeightFileHeader& header, uint64_t fileSize);
+
+// Read-only file mapped copy-on-write: the mapping can be written to, but
+// the changes stay private to the process and never reach the file.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+    bool Open(const char* path);
+    void Close();
+    unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+private:
+    unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};